@@ -0,0 +1,103 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "BatteryGovernor.h"
+
+
+// The lowest smoothed voltage each tier is allowed at and the milliamps it allows. The last tier has no lower limit.
+// The steps are for a 4 cell NiMH pack (5.6 V full, 4.4 V nearly flat) feeding the strips directly.
+const uint16_t PROGMEM BATTERY_TIER_MILLIVOLTS[BATTERY_NUM_TIERS-1] = {4900, 4700, 4550, 4400};
+const uint16_t PROGMEM BATTERY_TIER_MILLIAMPS[BATTERY_NUM_TIERS] = {BATTERY_NO_CAP, 300, 200, 125, 50};
+
+
+BatteryGovernor::BatteryGovernor() {
+    m_smoothed = 0;
+    m_started = false;
+    m_tier = 0;
+    m_sample_previous_millis = 0;
+}
+
+
+// Call every loop. Returns true when the milliamp cap has changed.
+bool BatteryGovernor::service() {
+    if ((millis() - m_sample_previous_millis) < BATTERY_SAMPLE_INTERVAL) {
+        return false;
+    }
+    m_sample_previous_millis = millis();
+
+    uint32_t millivolts = (static_cast<uint32_t>(analogRead(BATTERY_PIN))*BATTERY_AREF_MILLIVOLTS*BATTERY_DIVIDER_NUMERATOR)/(1024UL*BATTERY_DIVIDER_DENOMINATOR);
+    return update(millivolts);
+}
+
+
+// Feed one voltage sample. Returns true when the milliamp cap has changed.
+bool BatteryGovernor::update(uint16_t millivolts) {
+    uint8_t tier = m_tier;
+
+    if (!m_started) {
+        // start from the first reading instead of 0 V so the cap doesn't start at the bottom tier and climb
+        m_smoothed = static_cast<uint32_t>(millivolts) << BATTERY_SMOOTHING_SHIFT;
+        m_started = true;
+        tier = 0;
+    }
+    else {
+        m_smoothed = m_smoothed - (m_smoothed >> BATTERY_SMOOTHING_SHIFT) + millivolts;
+    }
+
+    uint16_t smoothed = get_millivolts();
+
+    // drop as many tiers as needed right away
+    while (tier < BATTERY_NUM_TIERS-1 && smoothed < pgm_read_word(&BATTERY_TIER_MILLIVOLTS[tier])) {
+        tier++;
+    }
+
+    // but only climb back up past the hysteresis
+    while (tier > 0 && smoothed >= pgm_read_word(&BATTERY_TIER_MILLIVOLTS[tier-1]) + BATTERY_HYSTERESIS_MILLIVOLTS) {
+        tier--;
+    }
+
+    bool changed = (tier != m_tier);
+    if (tier != m_tier) {
+        DEBUG_PRINT("battery mV: ");
+        DEBUG_PRINT(smoothed);
+        DEBUG_PRINT(" tier: ");
+        DEBUG_PRINTLN(tier);
+    }
+    m_tier = tier;
+
+    return changed;
+}
+
+
+uint16_t BatteryGovernor::get_millivolts() {
+    return m_smoothed >> BATTERY_SMOOTHING_SHIFT;
+}
+
+
+uint8_t BatteryGovernor::get_tier() {
+    return m_tier;
+}
+
+
+uint16_t BatteryGovernor::get_milliamps_cap() {
+    return pgm_read_word(&BATTERY_TIER_MILLIAMPS[m_tier]);
+}
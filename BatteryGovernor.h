@@ -0,0 +1,64 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef BATTERY_GOVERNOR_H
+#define BATTERY_GOVERNOR_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// The battery (or the 5 V rail it feeds) is measured through a voltage divider into BATTERY_PIN.
+// The ADC uses the external reference the mic already needs, so BATTERY_AREF_MILLIVOLTS must match what AREF is wired to.
+// With two equal resistors up to 2*BATTERY_AREF_MILLIVOLTS can be measured.
+#define BATTERY_PIN A2
+#define BATTERY_AREF_MILLIVOLTS 3300
+#define BATTERY_DIVIDER_NUMERATOR 2   // (R1+R2)/R2
+#define BATTERY_DIVIDER_DENOMINATOR 1
+
+#define BATTERY_SAMPLE_INTERVAL 250
+// Each sample moves the smoothed voltage 1/2^BATTERY_SMOOTHING_SHIFT of the way toward it, i.e. about 4 s to settle.
+#define BATTERY_SMOOTHING_SHIFT 4
+// Drawing less current lets a sagging battery's voltage recover, which would raise the cap again, draw more current
+// and sag again. So a tier is only left upward once the voltage is this far above the tier's threshold.
+#define BATTERY_HYSTERESIS_MILLIVOLTS 150
+
+#define BATTERY_NUM_TIERS 5
+#define BATTERY_NO_CAP UINT16_MAX
+
+// Tightens the LED strip's milliamp budget in steps as the battery drains. update() has no hardware dependencies,
+// so a simulated discharge curve can be fed straight into it.
+class BatteryGovernor {
+    uint32_t m_smoothed; // millivolts << BATTERY_SMOOTHING_SHIFT
+    bool m_started;
+    uint8_t m_tier;
+    uint32_t m_sample_previous_millis;
+
+  public:
+    BatteryGovernor();
+    bool service();
+    bool update(uint16_t millivolts);
+    uint16_t get_millivolts();
+    uint8_t get_tier();
+    uint16_t get_milliamps_cap();
+};
+
+#endif
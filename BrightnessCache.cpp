@@ -0,0 +1,122 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include <EEPROM.h>
+#include "BrightnessCache.h"
+#include "Settings.h"
+
+
+BrightnessCache::BrightnessCache() {
+    m_pattern = NUM_PATTERNS; // nothing selected yet
+    m_peak = BRIGHTNESS_CACHE_UNKNOWN;
+    m_global_peak = 0;
+    m_mW_per_unit = 1;
+    m_dirty = false;
+    m_dirty_previous_millis = 0;
+}
+
+
+// Call after SettingsStore::load(), which starts the EEPROM on boards that emulate it.
+void BrightnessCache::load(uint16_t num_leds) {
+    CRGB white = CRGB::White;
+    uint32_t full_white_mW = calculate_unscaled_power_mW(&white, 1)*num_leds;
+    m_mW_per_unit = max((full_white_mW + BRIGHTNESS_CACHE_MAX_PEAK - 1) / BRIGHTNESS_CACHE_MAX_PEAK, static_cast<uint32_t>(1));
+
+    uint16_t address = BRIGHTNESS_CACHE_EEPROM_ADDRESS;
+    if (EEPROM.read(address) != BRIGHTNESS_CACHE_VERSION ||
+        EEPROM.read(address+1) != lowByte(num_leds) || EEPROM.read(address+2) != highByte(num_leds)) {
+        // learned on other hardware, or never learned at all
+        eeprom_update(address, BRIGHTNESS_CACHE_VERSION);
+        eeprom_update(address+1, lowByte(num_leds));
+        eeprom_update(address+2, highByte(num_leds));
+        for (uint8_t i = 0; i < NUM_PATTERNS; i++) {
+            eeprom_update(address+BRIGHTNESS_CACHE_HEADER_SIZE+i, BRIGHTNESS_CACHE_UNKNOWN);
+        }
+        eeprom_commit();
+    }
+
+    m_global_peak = 0;
+    for (uint8_t i = 0; i < NUM_PATTERNS; i++) {
+        uint8_t peak = EEPROM.read(address+BRIGHTNESS_CACHE_HEADER_SIZE+i);
+        if (peak != BRIGHTNESS_CACHE_UNKNOWN && peak > m_global_peak) {
+            m_global_peak = peak;
+        }
+    }
+}
+
+
+// power_mW is what the frame just drawn would draw at full brightness, i.e. calculate_unscaled_power_mW(), for no
+// more LEDs than load() was given.
+void BrightnessCache::learn(Pattern pattern, uint32_t power_mW) {
+    if (pattern != m_pattern) {
+        select(pattern);
+    }
+
+    uint32_t units = (power_mW + m_mW_per_unit - 1) / m_mW_per_unit;
+    uint8_t peak = min(units, static_cast<uint32_t>(BRIGHTNESS_CACHE_MAX_PEAK));
+    if (m_peak == BRIGHTNESS_CACHE_UNKNOWN || peak > m_peak) {
+        m_peak = peak;
+        m_dirty = true;
+        m_dirty_previous_millis = millis();
+        if (peak > m_global_peak) {
+            m_global_peak = peak;
+        }
+    }
+}
+
+
+// The brightness that keeps the selected pattern, or with per_pattern false the hungriest pattern seen so far,
+// under milliamps.
+uint8_t BrightnessCache::get_brightness(uint16_t milliamps, bool per_pattern) {
+    uint8_t peak = per_pattern ? m_peak : m_global_peak;
+    if (peak == BRIGHTNESS_CACHE_UNKNOWN || peak == 0) {
+        return 255;
+    }
+
+    uint32_t max_power_mW = static_cast<uint32_t>(LED_STRIP_VOLTAGE)*milliamps;
+    uint32_t brightness = (max_power_mW*256) / (static_cast<uint32_t>(peak)*m_mW_per_unit);
+    return min(brightness, static_cast<uint32_t>(255));
+}
+
+
+// call every loop
+void BrightnessCache::service() {
+    if (m_dirty && (millis() - m_dirty_previous_millis) > BRIGHTNESS_CACHE_SAVE_DELAY) {
+        flush();
+    }
+}
+
+
+void BrightnessCache::flush() {
+    if (m_dirty) {
+        eeprom_update(BRIGHTNESS_CACHE_EEPROM_ADDRESS+BRIGHTNESS_CACHE_HEADER_SIZE+m_pattern, m_peak);
+        eeprom_commit();
+        m_dirty = false;
+    }
+}
+
+
+void BrightnessCache::select(Pattern pattern) {
+    flush(); // the peak belongs to the pattern that's being left
+    m_pattern = pattern;
+    m_peak = EEPROM.read(BRIGHTNESS_CACHE_EEPROM_ADDRESS+BRIGHTNESS_CACHE_HEADER_SIZE+m_pattern);
+}
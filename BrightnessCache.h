@@ -0,0 +1,67 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef BRIGHTNESS_CACHE_H
+#define BRIGHTNESS_CACHE_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Remembers, across power cycles, the most power each pattern has been seen to draw at full brightness, so
+// homogenize_brightness() knows the right brightness for a pattern from its first frame instead of working its way
+// down to it while the pattern runs.
+//
+// FastLED's power model is linear in the brightness, so the brightness that keeps a pattern under any milliamp
+// setting is the milliamps times the voltage over the pattern's peak full brightness power. One byte per pattern
+// therefore covers every setting, where a table with a byte per pattern and milliamp setting would need 416 bytes.
+// The peak only ever goes up. A change of milliamp setting is a division instead of relearning.
+//
+// Peaks are stored in units of 1/254 of what the strip draws at full white, so the same byte covers a strip of any
+// length, rounded up so the brightness they give never makes FastLED's own limit kick in. A new peak is written once it has stopped going up for BRIGHTNESS_CACHE_SAVE_DELAY,
+// which after the first few runs of a pattern is almost never. The table is cleared if the number of LEDs changes.
+#define BRIGHTNESS_CACHE_VERSION 2
+#define BRIGHTNESS_CACHE_HEADER_SIZE 3
+#define BRIGHTNESS_CACHE_UNKNOWN 0xFF // what erased EEPROM reads as
+#define BRIGHTNESS_CACHE_MAX_PEAK (BRIGHTNESS_CACHE_UNKNOWN-1)
+#define BRIGHTNESS_CACHE_SAVE_DELAY 5000
+
+class BrightnessCache {
+    uint8_t m_pattern;
+    uint8_t m_peak;
+    uint8_t m_global_peak;
+    uint16_t m_mW_per_unit;
+    bool m_dirty;
+    uint32_t m_dirty_previous_millis;
+
+  public:
+    BrightnessCache();
+    void load(uint16_t num_leds);
+    void learn(Pattern pattern, uint32_t power_mW);
+    uint8_t get_brightness(uint16_t milliamps, bool per_pattern);
+    void service();
+    void flush();
+
+  private:
+    void select(Pattern pattern);
+};
+
+#endif
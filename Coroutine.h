@@ -0,0 +1,70 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdint.h>
+
+
+// Stackless coroutines (protothreads) so a pattern with several phases can be written as straight line code
+// instead of a state machine of flags and countdowns. The body of a coroutine goes between CO_BEGIN() and CO_END()
+// in a function that returns void. CO_YIELD() returns from the function and the next call carries on from just after
+// it. CO_YIELD_FOR() does the same but keeps returning until the wait is over.
+//
+//     if (is_wait_over(draw_interval)) {
+//         CO_BEGIN(co, now());
+//         for (;;) {
+//             ...draw one frame of the first phase...
+//             CO_YIELD(co);
+//             ...
+//             CO_YIELD_FOR(co, 1000);
+//         }
+//         CO_END(co);
+//     }
+//
+// Because the function really does return, local variables are gone when it resumes. Anything that has to survive a
+// yield goes in the pattern's PatternState. The body can't contain a switch statement of its own, since the resume
+// points are case labels of the switch CO_BEGIN() opens.
+//
+// A Coroutine is 3 bytes on the Nano (4 where uint16_t is aligned) and all zeros means "start from the top", so
+// zeroing PatternState or calling CO_RESET() restarts it. Waits are kept in 16 bits and so can be up to 32767 ms long.
+struct Coroutine {
+    uint8_t resume_point;
+    uint16_t wake_time;
+};
+
+#define CO_RESET(co) ((co).resume_point = 0)
+
+#define CO_BEGIN(co, time) { const uint16_t co_time = (time); (void)co_time; switch ((co).resume_point) { case 0:
+
+#define CO_END(co) } (co).resume_point = 0; }
+
+// __COUNTER__ is expanded once before CO_YIELD_AT() uses it twice, so each yield gets its own resume point
+#define CO_YIELD(co) CO_YIELD_AT(co, __COUNTER__+1)
+#define CO_YIELD_AT(co, n) do { (co).resume_point = (n); return; case (n):; } while (0)
+
+#define CO_YIELD_FOR(co, ms) CO_YIELD_FOR_AT(co, ms, __COUNTER__+1)
+#define CO_YIELD_FOR_AT(co, ms, n) do { (co).wake_time = co_time + (ms); (co).resume_point = (n); return; \
+                                        case (n): if (static_cast<int16_t>(co_time - (co).wake_time) < 0) return; } while (0)
+
+#endif
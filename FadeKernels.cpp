@@ -0,0 +1,82 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "FadeKernels.h"
+
+
+// scale8() multiplies by (1+scale) and fadeToBlackBy() uses scale = 255-decay, so each byte is multiplied by 256-decay.
+// The largest product is 255*256 = 65280 which fits in 16 bits, therefore on a 32 bit processor two bytes can be
+// packed into one word and scaled with a single multiply without one lane spilling into the other.
+void fade_bytes(uint8_t *bytes, uint16_t num_bytes, uint8_t decay) {
+    const uint16_t scale = 256 - decay;
+    uint16_t i = 0;
+
+#if !defined(__AVR__)
+    for (; i+4 <= num_bytes; i+=4) {
+        uint32_t w;
+        memcpy(&w, bytes+i, sizeof(w));
+        uint32_t even = (((w & 0x00FF00FF)*scale) >> 8) & 0x00FF00FF;
+        uint32_t odd = (((w >> 8) & 0x00FF00FF)*scale) & 0xFF00FF00;
+        w = even | odd;
+        memcpy(bytes+i, &w, sizeof(w));
+    }
+#endif
+
+    // AVR has an 8x8 hardware multiply so one byte at a time is already the best it can do
+    for (; i < num_bytes; i++) {
+        bytes[i] = (bytes[i]*scale) >> 8;
+    }
+}
+
+
+// Calling random8() for every pixel costs a full random16() update each time, so instead one random16() is drawn
+// for every pair of pixels. random16() is a mod 65536 LCG so its low byte has a short period, which is why random8()
+// adds the high byte to it. The first pixel gets that same sum and the second pixel gets the high byte on its own.
+uint16_t fade_bytes_randomly(uint8_t *bytes, uint16_t num_pixels, uint8_t chance_of_fade, uint8_t decay) {
+    const uint16_t scale = 256 - decay;
+    uint16_t mask = 0;
+    uint16_t lit_pixels = 0;
+
+    for (uint16_t i = 0; i < num_pixels; i++) {
+        uint8_t r;
+        if ((i & 1) == 0) {
+            mask = random16();
+            r = (uint8_t)(mask + (mask >> 8));
+        }
+        else {
+            r = mask >> 8;
+        }
+
+        if (chance_of_fade > r) {
+            bytes[0] = (bytes[0]*scale) >> 8;
+            bytes[1] = (bytes[1]*scale) >> 8;
+            bytes[2] = (bytes[2]*scale) >> 8;
+        }
+
+        if (bytes[0] | bytes[1] | bytes[2]) {
+            lit_pixels++;
+        }
+        bytes += 3;
+    }
+
+    return lit_pixels;
+}
@@ -0,0 +1,45 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef FADE_KERNELS_H
+#define FADE_KERNELS_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// These kernels treat an LED buffer as packed bytes (three per pixel) instead of as an array of CRGB.
+// fade_bytes() gives the same result as FastLED's fadeToBlackBy() (i.e. every channel is multiplied by 256-decay
+// and shifted right 8 bits), but it can scale several bytes per multiply on 32 bit processors.
+// fade_bytes_randomly() visits every pixel anyway so it returns how many pixels are still lit afterwards, which
+// saves callers a second pass over the strip when they need to know if it has gone dark.
+void fade_bytes(uint8_t *bytes, uint16_t num_bytes, uint8_t decay);
+uint16_t fade_bytes_randomly(uint8_t *bytes, uint16_t num_pixels, uint8_t chance_of_fade, uint8_t decay);
+
+inline void fade_leds(CRGB *leds, uint16_t num_leds, uint8_t decay) {
+    fade_bytes(reinterpret_cast<uint8_t *>(leds), 3*num_leds, decay);
+}
+
+inline uint16_t fade_leds_randomly(CRGB *leds, uint16_t num_leds, uint8_t chance_of_fade, uint8_t decay) {
+    return fade_bytes_randomly(reinterpret_cast<uint8_t *>(leds), num_leds, chance_of_fade, decay);
+}
+
+#endif
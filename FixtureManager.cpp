@@ -0,0 +1,125 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "FixtureManager.h"
+
+
+FixtureManager::FixtureManager(uint16_t frame_budget_us) {
+    m_num_fixtures = 0;
+    m_next = 0;
+    m_frame_budget_us = frame_budget_us;
+    m_sync = false;
+    m_frame_us = 0;
+    m_fixtures_rendered = 0;
+}
+
+
+// returns the fixture's index or INT8_MIN if there is no room left
+int8_t FixtureManager::add_fixture(ReAnimator *fixture) {
+    if (fixture == NULL || m_num_fixtures == MAX_FIXTURES) {
+        return INT8_MIN;
+    }
+
+    m_fixtures[m_num_fixtures] = fixture;
+    if (m_sync && m_num_fixtures > 0) {
+        fixture->follow(m_fixtures[0]);
+    }
+
+    return m_num_fixtures++;
+}
+
+
+uint8_t FixtureManager::get_num_fixtures() {
+    return m_num_fixtures;
+}
+
+
+ReAnimator *FixtureManager::get_fixture(uint8_t i) {
+    return (i < m_num_fixtures) ? m_fixtures[i] : NULL;
+}
+
+
+uint16_t FixtureManager::get_frame_budget() {
+    return m_frame_budget_us;
+}
+
+
+void FixtureManager::set_frame_budget(uint16_t frame_budget_us) {
+    m_frame_budget_us = frame_budget_us;
+}
+
+
+bool FixtureManager::get_sync() {
+    return m_sync;
+}
+
+
+void FixtureManager::set_sync(bool sync) {
+    m_sync = sync;
+    for (uint8_t i = 1; i < m_num_fixtures; i++) {
+        m_fixtures[i]->follow(sync ? m_fixtures[0] : NULL);
+    }
+}
+
+
+void FixtureManager::reanimate() {
+    if (m_num_fixtures == 0) {
+        return;
+    }
+
+    uint32_t start_us = micros();
+    m_fixtures_rendered = 0;
+
+    do {
+        m_fixtures[m_next]->reanimate();
+        m_next = (m_next + 1) % m_num_fixtures;
+        m_fixtures_rendered++;
+    } while (m_fixtures_rendered < m_num_fixtures && (micros() - start_us) < m_frame_budget_us);
+
+    m_frame_us = micros() - start_us;
+
+    // FastLED only has one global brightness, so every fixture gets the lowest brightness any of them has learned
+    // instead of whichever fixture happened to render last
+    uint8_t brightness = 255;
+    for (uint8_t i = 0; i < m_num_fixtures; i++) {
+        brightness = min(brightness, m_fixtures[i]->get_homogenized_brightness());
+    }
+    FastLED.setBrightness(brightness);
+
+    // printing every frame would take longer than the frame it reports on
+    EVERY_N_SECONDS(10) {
+        DEBUG_PRINT("fixtures rendered: ");
+        DEBUG_PRINT(m_fixtures_rendered);
+        DEBUG_PRINT(" frame us: ");
+        DEBUG_PRINTLN(m_frame_us);
+    }
+}
+
+
+uint32_t FixtureManager::get_frame_us() {
+    return m_frame_us;
+}
+
+
+uint8_t FixtureManager::get_fixtures_rendered() {
+    return m_fixtures_rendered;
+}
@@ -0,0 +1,76 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef FIXTURE_MANAGER_H
+#define FIXTURE_MANAGER_H
+
+#include "UFO_LEDs_controller.h"
+#include "ReAnimator.h"
+
+
+// Each ReAnimator and its layers take most of 1 KB, so a Nano only has room for one
+// and UFO_LEDs_controller.ino drives its single ReAnimator directly without a FixtureManager. Boards with more RAM can drive up to MAX_FIXTURES props, each on its own strips, e.g.
+//   ReAnimatorLayers<NUM_RIM_LEDS> layers_a, layers_b;
+//   ReAnimator ufo_a(rim_a, beam_a, helm_a, layers_a, &rim_hue, &beam_hue, LED_STRIP_INITIAL_MILLIAMPS);
+//   ReAnimator ufo_b(rim_b, beam_b, helm_b, layers_b, &rim_hue, &beam_hue, LED_STRIP_INITIAL_MILLIAMPS);
+//   FixtureManager fixtures(10000);
+//   fixtures.add_fixture(&ufo_a);
+//   fixtures.add_fixture(&ufo_b);
+// then call fixtures.reanimate() and FastLED.show() from loop().
+// A fixture can also be a single strip, which runs the same patterns on however many LEDs it has, with layers only
+// that long, e.g.
+//   ReAnimatorLayers<NUM_LAMP_LEDS> lamp_layers;
+//   ReAnimator lamp(Span{lamp_leds, NUM_LAMP_LEDS, 1, 0}, lamp_layers, &rim_hue, LED_STRIP_INITIAL_MILLIAMPS);
+#define MAX_FIXTURES 4
+
+// Owns the fixtures' ReAnimators and renders them round-robin. Every call to reanimate() renders fixtures until the
+// frame budget is spent, always at least one, and the next call picks up with the fixture after the last one rendered.
+// When the fixtures don't all fit in one frame they are rendered less often but none of them is ever starved.
+// With sync enabled every fixture follows fixture 0 (see ReAnimator::follow()), so they run the same pattern and draw
+// on the same ticks.
+class FixtureManager {
+    ReAnimator *m_fixtures[MAX_FIXTURES];
+    uint8_t m_num_fixtures;
+    uint8_t m_next;
+    uint16_t m_frame_budget_us;
+    bool m_sync;
+    uint32_t m_frame_us;
+    uint8_t m_fixtures_rendered;
+
+  public:
+    FixtureManager(uint16_t frame_budget_us);
+    int8_t add_fixture(ReAnimator *fixture);
+    uint8_t get_num_fixtures();
+    ReAnimator *get_fixture(uint8_t i);
+
+    uint16_t get_frame_budget();
+    void set_frame_budget(uint16_t frame_budget_us);
+    bool get_sync();
+    void set_sync(bool sync);
+
+    void reanimate();
+
+    uint32_t get_frame_us();
+    uint8_t get_fixtures_rendered();
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "FrameExchange.h"
+
+
+FrameExchange::FrameExchange() {
+    for (uint8_t i = 0; i < sizeof(m_slots)/sizeof(m_slots[0]); i++) {
+        fill_solid(m_slots[i].rim, NUM_RIM_LEDS, CRGB::Black);
+        fill_solid(m_slots[i].beam, NUM_BEAM_LEDS, CRGB::Black);
+        fill_solid(m_slots[i].helm, NUM_HELM_LEDS, CRGB::Black);
+        m_slots[i].brightness = 0;
+    }
+    m_back = 0;
+    m_middle = 1;
+    m_front = 2;
+    m_published = 0;
+    m_taken = 0;
+}
+
+
+// The slot to write the next frame into. It belongs to the producer until publish().
+Frame &FrameExchange::back() {
+    return m_slots[m_back];
+}
+
+
+void FrameExchange::publish() {
+    // the release makes the frame's contents visible to the consumer before the index that points at them
+    uint8_t previous = __atomic_exchange_n(&m_middle, static_cast<uint8_t>(m_back | FRESH), __ATOMIC_ACQ_REL);
+    m_back = previous & INDEX_MASK;
+    __atomic_fetch_add(&m_published, 1, __ATOMIC_RELAXED);
+}
+
+
+// Returns true if a frame has been published since the last call, front() is then that frame.
+bool FrameExchange::acquire() {
+    if (!(__atomic_load_n(&m_middle, __ATOMIC_ACQUIRE) & FRESH)) {
+        return false;
+    }
+
+    uint8_t previous = __atomic_exchange_n(&m_middle, m_front, __ATOMIC_ACQ_REL);
+    m_front = previous & INDEX_MASK;
+    __atomic_fetch_add(&m_taken, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+
+// The most recently acquired frame. It belongs to the consumer until the next acquire().
+Frame &FrameExchange::front() {
+    return m_slots[m_front];
+}
+
+
+uint32_t FrameExchange::get_published() {
+    return __atomic_load_n(&m_published, __ATOMIC_RELAXED);
+}
+
+
+uint32_t FrameExchange::get_taken() {
+    return __atomic_load_n(&m_taken, __ATOMIC_RELAXED);
+}
+
+
+uint32_t FrameExchange::get_dropped() {
+    return get_published() - get_taken();
+}
@@ -0,0 +1,73 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef FRAME_EXCHANGE_H
+#define FRAME_EXCHANGE_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Hands finished frames from the task that renders them to a task that sends them to the LEDs, so on a dual core
+// board frame N+1 is rendered while frame N is being transmitted. The patterns keep drawing into the sketch's own
+// arrays, which are never swapped, so the patterns that read back the previous frame are unaffected. Each finished
+// frame is copied into the producer's back slot and published.
+//
+// There are three slots: the producer's back slot, the consumer's front slot and one in between that the two sides
+// swap with a single atomic exchange. Neither side ever waits for the other or takes a lock. If the producer
+// publishes faster than the consumer sends, the older unsent frame is replaced (and counted in get_dropped()).
+// One producer and one consumer only. Three frames of 83 LEDs is 750 bytes, so this is meant for ESP32-class boards.
+struct Frame {
+    CRGB rim[NUM_RIM_LEDS];
+    CRGB beam[NUM_BEAM_LEDS];
+    CRGB helm[NUM_HELM_LEDS];
+    uint8_t brightness;
+};
+
+class FrameExchange {
+    static const uint8_t FRESH = 0x80; // set in m_middle when it holds a frame the consumer hasn't taken yet
+    static const uint8_t INDEX_MASK = 0x03;
+
+    Frame m_slots[3];
+    uint8_t m_back;   // producer only
+    uint8_t m_middle; // shared, only touched atomically
+    uint8_t m_front;  // consumer only
+
+    uint32_t m_published;
+    uint32_t m_taken;
+
+  public:
+    FrameExchange();
+
+    // producer side
+    Frame &back();
+    void publish();
+
+    // consumer side
+    bool acquire();
+    Frame &front();
+
+    uint32_t get_published();
+    uint32_t get_taken();
+    uint32_t get_dropped();
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "FrameStream.h"
+#include "Settings.h"
+
+
+FrameStream::FrameStream(HardwareSerial &serial, CRGB *rim_leds, CRGB *beam_leds, CRGB *helm_leds) : m_serial(serial) {
+    m_rim_leds = rim_leds;
+    m_beam_leds = beam_leds;
+    m_helm_leds = helm_leds;
+
+    m_received = 0;
+    m_crc = 0;
+    m_sequence = 0;
+    m_frame_sequence = 0;
+    m_byte_previous_millis = 0;
+    m_ack_pending = false;
+
+    m_streaming = false;
+    m_frame_previous_millis = 0;
+    m_frames = 0;
+    m_dropped_frames = 0;
+}
+
+
+void FrameStream::begin(uint32_t baud) {
+    m_serial.begin(baud);
+}
+
+
+// Call once per loop. Returns true when a new frame has been copied into the LED arrays and needs to be shown.
+// The acknowledgement for a frame is sent on the next call, after the sketch has had a chance to show it.
+bool FrameStream::service() {
+    bool new_frame = false;
+
+    if (m_ack_pending) {
+        m_serial.write(STREAM_ACK);
+        m_ack_pending = false;
+    }
+
+    while (m_serial.available() > 0 && !new_frame) {
+        uint8_t b = m_serial.read();
+        m_byte_previous_millis = millis();
+
+        if (m_received == 0) {
+            m_received = (b == 'U') ? 1 : 0;
+        }
+        else if (m_received == 1) {
+            m_received = (b == 'F') ? 2 : ((b == 'U') ? 1 : 0);
+            m_crc = 0;
+        }
+        else if (m_received == 2) {
+            // only trusted once the CRC has checked out
+            m_frame_sequence = b;
+            m_crc = crc8_update(m_crc, b);
+            m_received++;
+        }
+        else if (m_received < STREAM_FRAME_SIZE-1) {
+            m_back_buffer[m_received-3] = b;
+            m_crc = crc8_update(m_crc, b);
+            m_received++;
+        }
+        else {
+            // the last byte is the CRC, a bad frame is dropped and the last good one stays up
+            if (b == m_crc) {
+                uint8_t expected = m_sequence + 1;
+                if (m_frames > 0 && m_frame_sequence != expected) {
+                    m_dropped_frames += static_cast<uint8_t>(m_frame_sequence - expected);
+                }
+                m_sequence = m_frame_sequence;
+                swap();
+                new_frame = true;
+            }
+            else {
+                m_dropped_frames++;
+                m_ack_pending = true; // the host is waiting, ask for the next frame anyway
+            }
+            m_received = 0;
+        }
+    }
+
+    if (m_received > 0 && (millis() - m_byte_previous_millis) > STREAM_BYTE_TIMEOUT) {
+        m_received = 0; // the rest of the frame isn't coming, e.g. a stray 'U' that wasn't a frame at all
+    }
+
+    if (m_streaming && (millis() - m_frame_previous_millis) > STREAM_TIMEOUT) {
+        m_streaming = false;
+        m_received = 0;
+        DEBUG_PRINTLN("stream timed out");
+    }
+
+    return new_frame;
+}
+
+
+// Also true while a frame is arriving, including the first one, since showing anything then would lose its bytes.
+bool FrameStream::is_streaming() {
+    return m_streaming || m_received > 0;
+}
+
+
+uint16_t FrameStream::get_frames() {
+    return m_frames;
+}
+
+
+uint16_t FrameStream::get_dropped_frames() {
+    return m_dropped_frames;
+}
+
+
+// the LED arrays are only ever touched here, between shows, so FastLED never sends half of one frame and half of another
+void FrameStream::swap() {
+    const uint8_t *p = m_back_buffer;
+    memcpy(m_rim_leds, p, NUM_RIM_LEDS*sizeof(CRGB));
+    p += NUM_RIM_LEDS*sizeof(CRGB);
+    memcpy(m_beam_leds, p, NUM_BEAM_LEDS*sizeof(CRGB));
+    p += NUM_BEAM_LEDS*sizeof(CRGB);
+    memcpy(m_helm_leds, p, NUM_HELM_LEDS*sizeof(CRGB));
+
+    m_streaming = true;
+    m_frame_previous_millis = millis();
+    m_frames++;
+    m_ack_pending = true;
+}
@@ -0,0 +1,86 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Lets a host computer render frames that are too heavy for the Nano and stream them over the USB serial port.
+// Frames arrive into a back buffer. Only a complete frame with a good CRC is copied into the LED arrays, so a
+// partial or corrupted frame is never shown. FastLED's power limit still applies when the frame is shown and the
+// sketch still homogenizes the rim's brightness. If no good frame arrives for STREAM_TIMEOUT the sketch goes back
+// to running its own patterns.
+//
+// Frame (STREAM_FRAME_SIZE bytes): 'U' 'F', sequence number, RGB bytes for the rim, then the beam,
+// then the helm (STREAM_PIXEL_BYTES in all), CRC-8 of everything after the two start bytes.
+//
+// FastLED turns interrupts off while it shows a frame (about 2.5 ms for 83 LEDs), and bytes arriving then are
+// lost because the UART only holds 2 of them. So the host must send one frame and then wait for STREAM_ACK, which
+// is sent once that frame has been shown, and while is_streaming() the sketch must only show when service() returns
+// true, never while a frame is arriving. Best case frames per second is then 1/(wire time + show time + ~1 ms).
+// These are estimates worked out from the wire and show times, they haven't been measured on a Nano:
+//     115200 baud: 2530 bits -> 22.0 ms + 3.5 ms -> ~39 fps
+//     250000 baud:              10.1 ms + 3.5 ms -> ~73 fps
+//     500000 baud:               5.1 ms + 3.5 ms -> ~116 fps
+//    1000000 baud:               2.5 ms + 3.5 ms -> ~166 fps
+// 250000, 500000 and 1000000 divide evenly into the Nano's 16 MHz clock, 115200 is 2.1% off but still works.
+#define STREAM_PIXEL_BYTES (3*(NUM_RIM_LEDS+NUM_BEAM_LEDS+NUM_HELM_LEDS))
+#define STREAM_FRAME_SIZE (2+1+STREAM_PIXEL_BYTES+1)
+#define STREAM_ACK 0x06
+#define STREAM_TIMEOUT 1000
+// a frame that stops arriving for this long is abandoned
+#define STREAM_BYTE_TIMEOUT 20
+
+class FrameStream {
+    HardwareSerial &m_serial;
+    CRGB *m_rim_leds;
+    CRGB *m_beam_leds;
+    CRGB *m_helm_leds;
+
+    uint8_t m_back_buffer[STREAM_PIXEL_BYTES];
+    uint16_t m_received;
+    uint8_t m_crc;
+    uint8_t m_sequence;
+    uint8_t m_frame_sequence;
+    uint32_t m_byte_previous_millis;
+    bool m_ack_pending;
+
+    bool m_streaming;
+    uint32_t m_frame_previous_millis;
+    uint16_t m_frames;
+    uint16_t m_dropped_frames;
+
+  public:
+    FrameStream(HardwareSerial &serial, CRGB *rim_leds, CRGB *beam_leds, CRGB *helm_leds);
+    void begin(uint32_t baud);
+    bool service();
+    bool is_streaming();
+    uint16_t get_frames();
+    uint16_t get_dropped_frames();
+
+  private:
+    void swap();
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "Geometry.h"
+
+
+// around the vertical axis, 256 is a full turn, LEDs on the axis are given 0
+const uint8_t GEOMETRY_ANGLE[GEOMETRY_NUM_LEDS] PROGMEM = {
+    // rim
+    0, 5, 10, 15, 20, 25, 30, 34, 39, 44, 49, 54, 59,
+    64, 69, 74, 79, 84, 89, 94, 98, 103, 108, 113, 118, 123,
+    128, 133, 138, 143, 148, 153, 158, 162, 167, 172, 177, 182, 187,
+    192, 197, 202, 207, 212, 217, 222, 226, 231, 236, 241, 246, 251,
+    // beam
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // helm
+    0, 43, 85, 128, 171, 213, 0
+};
+
+
+// distance from the vertical axis, 255 is the rim
+const uint8_t GEOMETRY_RADIUS[GEOMETRY_NUM_LEDS] PROGMEM = {
+    // rim
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    // beam
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // helm
+    80, 80, 80, 80, 80, 80, 0
+};
+
+
+// 0 is the bottom of the beam, 255 is the top of the helm
+const uint8_t GEOMETRY_HEIGHT[GEOMETRY_NUM_LEDS] PROGMEM = {
+    // rim
+    160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160,
+    160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160,
+    160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160,
+    160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160, 160,
+    // beam
+    120, 115, 110, 104, 99, 94, 89, 83, 78, 73, 68, 63, 57,
+    52, 47, 42, 37, 31, 26, 21, 16, 10, 5, 0,
+    // helm
+    215, 215, 215, 215, 215, 215, 255
+};
@@ -0,0 +1,44 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Where every LED of the UFO physically is, so an effect can travel across the rim, beam and helm as one object
+// instead of along each strip's indexes. The LEDs are numbered like FrameStream numbers them: the rim, then the beam,
+// then the helm. Each coordinate is a byte and has its own table so an effect only reads the one it uses.
+//   angle:  around the vertical axis, the rim's LED 0 is at 0 and 256 is a full turn
+//   radius: from the vertical axis, 0 on the axis and 255 at the rim
+//   height: 0 at the bottom of the beam and 255 at the top of the helm
+// The beam hangs down the axis from under the saucer with LED 0 at the top. The helm is taken to be six LEDs in a
+// ring around the dome with LED 6 on top. Heights between the strips are estimates, so if the helm or beam are wired
+// differently only these tables need to change.
+#define GEOMETRY_NUM_LEDS (NUM_RIM_LEDS+NUM_BEAM_LEDS+NUM_HELM_LEDS)
+
+extern const uint8_t GEOMETRY_ANGLE[GEOMETRY_NUM_LEDS] PROGMEM;
+extern const uint8_t GEOMETRY_RADIUS[GEOMETRY_NUM_LEDS] PROGMEM;
+extern const uint8_t GEOMETRY_HEIGHT[GEOMETRY_NUM_LEDS] PROGMEM;
+
+#endif
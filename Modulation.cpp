@@ -0,0 +1,148 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "Modulation.h"
+
+
+// one cycle each, starting and ending at 0
+static const uint8_t MOD_SINE_TABLE[64] PROGMEM = {
+      0,   1,   2,   5,  10,  15,  21,  29,  37,  47,  57,  67,  79,  90, 103, 115,
+    127, 140, 152, 165, 176, 188, 198, 208, 218, 226, 234, 240, 245, 250, 253, 254,
+    255, 254, 253, 250, 245, 240, 234, 226, 218, 208, 198, 188, 176, 165, 152, 140,
+    128, 115, 103,  90,  79,  67,  57,  47,  37,  29,  21,  15,  10,   5,   2,   1
+};
+
+// a triangle run through a cubic ease in and out, so it lingers at both ends and moves quickly through the middle
+static const uint8_t MOD_EASED_TABLE[64] PROGMEM = {
+      0,   0,   0,   1,   2,   4,   7,  11,  16,  23,  31,  41,  54,  68,  85, 105,
+    128, 150, 170, 187, 201, 214, 224, 232, 239, 244, 248, 251, 253, 254, 255, 255,
+    255, 255, 255, 254, 253, 251, 248, 244, 239, 232, 224, 214, 201, 187, 170, 150,
+    128, 105,  85,  68,  54,  41,  31,  23,  16,  11,   7,   4,   2,   1,   0,   0
+};
+
+
+Modulation::Modulation() {
+    clear();
+    m_previous_millis = 0;
+}
+
+
+// period is in ms. Returns -1 if slot doesn't exist.
+int8_t Modulation::set(uint8_t slot, ModSource source, ModTarget target, int8_t depth, uint16_t period) {
+    if (slot >= MODULATION_SLOTS || target >= NUM_MOD_TARGETS) {
+        return -1;
+    }
+
+    Modulator &m = m_modulators[slot];
+    m.source = source;
+    m.target = target;
+    m.depth = depth;
+    m.value = 0;
+    m.rate = 65535/max(period, static_cast<uint16_t>(1));
+    m.phase = 0;
+    return 0;
+}
+
+
+void Modulation::clear() {
+    memset(m_modulators, 0, sizeof(m_modulators));
+    memset(m_amounts, 0, sizeof(m_amounts));
+}
+
+
+// Call once per frame. t is the animation clock.
+void Modulation::update(uint32_t t, uint8_t sound_value, bool sound_peak) {
+    uint16_t dt = min(t - m_previous_millis, static_cast<uint32_t>(UINT16_MAX));
+    m_previous_millis = t;
+
+    memset(m_amounts, 0, sizeof(m_amounts));
+
+    for (uint8_t i = 0; i < MODULATION_SLOTS; i++) {
+        Modulator &m = m_modulators[i];
+        // how far an envelope or follower falls this frame
+        uint16_t decay = min(static_cast<uint32_t>(m.rate)*dt, static_cast<uint32_t>(UINT16_MAX));
+
+        switch (m.source) {
+            default:
+            case MOD_OFF:
+                continue;
+            case MOD_SINE:
+                m.value = lookup(MOD_SINE_TABLE, t*m.rate);
+                break;
+            case MOD_TRIANGLE:
+                m.phase = t*m.rate;
+                m.value = (m.phase < 32768) ? (m.phase >> 7) : ((65535 - m.phase) >> 7);
+                break;
+            case MOD_EASED:
+                m.value = lookup(MOD_EASED_TABLE, t*m.rate);
+                break;
+            case MOD_ENVELOPE:
+                m.phase = sound_peak ? 65535 : (m.phase - min(m.phase, decay));
+                m.value = scale8(m.phase >> 8, m.phase >> 8); // squared so it dies away like a struck note
+                break;
+            case MOD_SOUND_LEVEL:
+                if (sound_value >= (m.phase >> 8)) {
+                    m.phase = sound_value << 8;
+                }
+                else {
+                    m.phase -= min(static_cast<uint16_t>(m.phase - (sound_value << 8)), decay);
+                }
+                m.value = m.phase >> 8;
+                break;
+        }
+
+        m_amounts[m.target] += (static_cast<int16_t>(m.depth)*m.value)/128;
+    }
+
+    for (uint8_t i = 0; i < NUM_MOD_TARGETS; i++) {
+        m_amounts[i] = constrain(m_amounts[i], -255, 255);
+    }
+}
+
+
+uint16_t Modulation::interval(uint16_t draw_interval) {
+    return draw_interval - (static_cast<int32_t>(draw_interval)*m_amounts[MOD_SPEED])/512;
+}
+
+
+uint8_t Modulation::hue(uint8_t hue) {
+    return hue + m_amounts[MOD_HUE];
+}
+
+
+uint8_t Modulation::fade(uint8_t fade) {
+    return constrain(fade + m_amounts[MOD_FADE]/2, 0, 255);
+}
+
+
+uint8_t Modulation::size(uint8_t size) {
+    return constrain(size + (static_cast<int16_t>(size)*m_amounts[MOD_SIZE])/256, 1, 255);
+}
+
+
+// phase is a whole cycle over 65536, the top 6 bits pick the step and the next 8 blend towards the step after it
+uint8_t Modulation::lookup(const uint8_t *table, uint16_t phase) {
+    uint8_t i = phase >> 10;
+    uint8_t a = pgm_read_byte(&table[i]);
+    uint8_t b = pgm_read_byte(&table[(i+1) & 63]);
+    return lerp8by8(a, b, (phase >> 2) & 0xFF);
+}
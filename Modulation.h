@@ -0,0 +1,81 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef MODULATION_H
+#define MODULATION_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Modulators that vary a pattern's speed, hue, fade or size while it runs. Each slot has a source and a target:
+//   MOD_SINE, MOD_TRIANGLE, MOD_EASED  LFOs with a period of period ms. Their phase comes straight from the animation
+//                                      clock, so controllers kept in step by a SyncLink modulate in step too.
+//   MOD_ENVELOPE                       jumps to full on each sound peak and dies away over period ms
+//   MOD_SOUND_LEVEL                    follows the sound level up straight away and back down over period ms
+// A modulator's output runs from 0 to 255 and is multiplied by depth/128, so a negative depth modulates the other
+// way. The outputs for each target are added together:
+//   MOD_SPEED  +255 halves the draw interval, -255 makes it 1.5 times as long
+//   MOD_HUE    added to the rim hue, 255 is the whole way round the color wheel
+//   MOD_FADE   half of it is added to how much the pattern fades each frame
+//   MOD_SIZE   +255 doubles the size, -255 shrinks it to 1
+// Fade and size only apply to the patterns that take them as arguments (shooting star, mitosis and sparkle).
+//
+// update() is one table lookup or one decay step per slot per frame. The LFO tables are 64 steps long and read with
+// linear interpolation, 128 bytes of flash.
+//
+//   GlowSerum.set_modulator(0, MOD_SINE, MOD_HUE, 32, 8000);        // drift the hue back and forth every 8 s
+//   GlowSerum.set_modulator(1, MOD_ENVELOPE, MOD_SPEED, 127, 400);  // speed up on each beat
+#define MODULATION_SLOTS 4
+
+enum ModSource {MOD_OFF = 0, MOD_SINE = 1, MOD_TRIANGLE = 2, MOD_EASED = 3, MOD_ENVELOPE = 4, MOD_SOUND_LEVEL = 5};
+enum ModTarget {MOD_SPEED = 0, MOD_HUE = 1, MOD_FADE = 2, MOD_SIZE = 3};
+#define NUM_MOD_TARGETS 4
+
+struct Modulator {
+    uint8_t source;
+    uint8_t target;
+    int8_t depth;
+    uint8_t value;
+    uint16_t rate; // phase per ms, a whole cycle is 65536
+    uint16_t phase;
+};
+
+class Modulation {
+    Modulator m_modulators[MODULATION_SLOTS];
+    int16_t m_amounts[NUM_MOD_TARGETS];
+    uint32_t m_previous_millis;
+
+  public:
+    Modulation();
+    int8_t set(uint8_t slot, ModSource source, ModTarget target, int8_t depth, uint16_t period);
+    void clear();
+    void update(uint32_t t, uint8_t sound_value, bool sound_peak);
+    uint16_t interval(uint16_t draw_interval);
+    uint8_t hue(uint8_t hue);
+    uint8_t fade(uint8_t fade);
+    uint8_t size(uint8_t size);
+
+  private:
+    static uint8_t lookup(const uint8_t *table, uint16_t phase);
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "NECDecoder.h"
+
+
+NECDecoder::NECDecoder() {
+    m_input = NULL;
+    m_mask = 0;
+
+    m_state = NEC_IDLE;
+    m_mark = false;
+    m_bits = 0;
+    m_data = 0;
+    m_previous_edge = 0;
+    m_previous_edge_millis = 0;
+
+    m_code = 0;
+    m_ready = false;
+
+    m_frames = 0;
+    m_repeats = 0;
+    m_errors = 0;
+}
+
+
+// Takes over Timer1 and the pin change interrupt for pin. The sketch's ISR for that pin's group has to call
+// handle_edge().
+void NECDecoder::begin(uint8_t pin) {
+    pinMode(pin, INPUT);
+#if defined(__AVR__)
+    m_input = portInputRegister(digitalPinToPort(pin));
+    m_mask = digitalPinToBitMask(pin);
+
+    // normal mode, clock/64 -> 4 us per tick, wraps every 262 ms
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11) | _BV(CS10);
+
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    PCIFR = _BV(digitalPinToPCICRbit(pin));
+    *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+#endif
+}
+
+
+// Call from the pin change ISR.
+void NECDecoder::handle_edge() {
+#if defined(__AVR__)
+    uint16_t now = TCNT1;
+    uint16_t now_millis = millis();
+    bool mark = !(*m_input & m_mask); // the receiver's output is low during a mark
+
+    // Timer1 wraps every 262 ms, so after a long quiet spell the duration it gives is meaningless
+    if (m_state != NEC_IDLE && static_cast<uint16_t>(now_millis - m_previous_edge_millis) > NEC_EDGE_TIMEOUT) {
+        m_errors++;
+        m_state = NEC_IDLE;
+    }
+
+    edge(now - m_previous_edge, mark);
+    m_previous_edge = now;
+    m_previous_edge_millis = now_millis;
+#endif
+}
+
+
+// duration is how many ticks the level that just ended lasted and mark is true if the new level is a mark.
+// Has no hardware dependencies, so recorded or synthetic mark/space traces can be fed straight into it.
+void NECDecoder::edge(uint16_t duration, bool mark) {
+    if (mark == m_mark) {
+        // an even number of edges were lost while interrupts were off
+        fail(mark);
+        return;
+    }
+    m_mark = mark;
+
+    switch (m_state) {
+        case NEC_IDLE:
+            if (mark) {
+                m_state = NEC_LEADER_MARK;
+            }
+            break;
+        case NEC_LEADER_MARK:
+            if (duration >= NEC_LEADER_MARK_MIN && duration <= NEC_LEADER_MARK_MAX) {
+                m_state = NEC_LEADER_SPACE;
+            }
+            else {
+                fail(mark);
+            }
+            break;
+        case NEC_LEADER_SPACE:
+            if (duration >= NEC_FRAME_SPACE_MIN && duration <= NEC_FRAME_SPACE_MAX) {
+                m_bits = 0;
+                m_data = 0;
+                m_state = NEC_BIT_MARK;
+            }
+            else if (duration >= NEC_REPEAT_SPACE_MIN && duration <= NEC_REPEAT_SPACE_MAX) {
+                m_state = NEC_REPEAT_MARK;
+            }
+            else {
+                fail(mark);
+            }
+            break;
+        case NEC_BIT_MARK:
+            if (duration < NEC_BIT_MARK_MIN || duration > NEC_BIT_MARK_MAX) {
+                fail(mark);
+            }
+            else if (m_bits == 32) {
+                // that was the stop mark
+                m_state = NEC_IDLE;
+                // the command byte is followed by its complement, IRremote's codes hold them in the low 16 bits
+                if (static_cast<uint8_t>(m_data >> 8) == static_cast<uint8_t>(~m_data)) {
+                    m_frames++;
+                    deliver(m_data);
+                }
+                else {
+                    m_errors++;
+                }
+            }
+            else {
+                m_state = NEC_BIT_SPACE;
+            }
+            break;
+        case NEC_BIT_SPACE:
+            if (duration >= NEC_ZERO_SPACE_MIN && duration < NEC_ONE_SPACE_MIN) {
+                m_data = m_data << 1;
+            }
+            else if (duration >= NEC_ONE_SPACE_MIN && duration <= NEC_ONE_SPACE_MAX) {
+                m_data = (m_data << 1) | 1;
+            }
+            else {
+                fail(mark);
+                break;
+            }
+            m_bits++;
+            m_state = NEC_BIT_MARK;
+            break;
+        case NEC_REPEAT_MARK:
+            m_state = NEC_IDLE;
+            if (duration >= NEC_BIT_MARK_MIN && duration <= NEC_BIT_MARK_MAX) {
+                m_repeats++;
+                deliver(NEC_REPEAT);
+            }
+            else {
+                m_errors++;
+            }
+            break;
+    }
+}
+
+
+// Returns true and sets code when a frame has been decoded since the last call.
+bool NECDecoder::decode(uint32_t &code) {
+    bool ready;
+
+    noInterrupts();
+    ready = m_ready;
+    if (ready) {
+        code = m_code;
+        m_ready = false;
+    }
+    interrupts();
+
+    return ready;
+}
+
+
+// False while a frame is arriving. Sending LEDs then would turn interrupts off in the middle of it.
+bool NECDecoder::is_idle() {
+    bool idle;
+
+    noInterrupts();
+    if (m_state != NEC_IDLE && static_cast<uint16_t>(static_cast<uint16_t>(millis()) - m_previous_edge_millis) > NEC_EDGE_TIMEOUT) {
+        // the rest of the frame never came
+        m_errors++;
+        m_state = NEC_IDLE;
+    }
+    idle = (m_state == NEC_IDLE);
+    interrupts();
+
+    return idle;
+}
+
+
+uint16_t NECDecoder::get_frames() {
+    return m_frames;
+}
+
+
+uint16_t NECDecoder::get_repeats() {
+    return m_repeats;
+}
+
+
+uint16_t NECDecoder::get_errors() {
+    return m_errors;
+}
+
+
+// A frame went wrong. If a mark has just started it may be the leader of the next frame, so start over from there.
+void NECDecoder::fail(bool mark) {
+    m_errors++;
+    m_mark = mark;
+    m_state = mark ? NEC_LEADER_MARK : NEC_IDLE;
+}
+
+
+void NECDecoder::deliver(uint32_t code) {
+    m_code = code;
+    m_ready = true;
+}
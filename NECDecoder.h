@@ -0,0 +1,95 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef NEC_DECODER_H
+#define NEC_DECODER_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Decodes NEC remote frames from the times of the IR receiver's edges instead of sampling it on a timer like
+// IRremote does. A pin change interrupt timestamps each edge with Timer1 running at 4 us per tick. Codes come out
+// the same as IRremote's, including 0xFFFFFFFF for the repeat frames sent while a button is held, so the sketch's
+// button table doesn't change.
+//
+// FastLED.show() turns interrupts off for about 2.5 ms. An edge during that time is only handled when it's over,
+// so it is timestamped late and edges after the first are lost. Two things make that survivable:
+//   - the leader mark is accepted from 5 ms, so a frame that starts while a frame of LEDs is being sent still
+//     decodes, and once the leader has started is_idle() is false so the sketch holds off showing until it's done
+//   - lost edges show up as two edges of the same level in a row or as a mark or space of the wrong length, and the
+//     frame is thrown away (and counted in get_errors()) instead of being decoded into the wrong code
+//
+// RAM is about 25 bytes, against more than 200 for IRremote's raw sample buffer and decode_results.
+#define NEC_TICK_US 4
+#define NEC_US_TO_TICKS(us) ((us)/NEC_TICK_US)
+#define NEC_LEADER_MARK_MIN NEC_US_TO_TICKS(5000)   // nominally 9000 us
+#define NEC_LEADER_MARK_MAX NEC_US_TO_TICKS(10500)
+#define NEC_FRAME_SPACE_MIN NEC_US_TO_TICKS(3500)   // nominally 4500 us
+#define NEC_FRAME_SPACE_MAX NEC_US_TO_TICKS(5500)
+#define NEC_REPEAT_SPACE_MIN NEC_US_TO_TICKS(1750)  // nominally 2250 us
+#define NEC_REPEAT_SPACE_MAX NEC_US_TO_TICKS(2800)
+#define NEC_BIT_MARK_MIN NEC_US_TO_TICKS(250)       // nominally 562 us
+#define NEC_BIT_MARK_MAX NEC_US_TO_TICKS(1000)
+#define NEC_ZERO_SPACE_MIN NEC_US_TO_TICKS(250)     // nominally 562 us
+#define NEC_ONE_SPACE_MIN NEC_US_TO_TICKS(900)      // nominally 1687 us
+#define NEC_ONE_SPACE_MAX NEC_US_TO_TICKS(2300)
+// the longest a level lasts inside a frame is the 9 ms leader mark, anything longer means the frame was abandoned
+#define NEC_EDGE_TIMEOUT 12
+#define NEC_REPEAT 0xFFFFFFFF
+
+enum NECState {NEC_IDLE = 0, NEC_LEADER_MARK = 1, NEC_LEADER_SPACE = 2, NEC_BIT_MARK = 3, NEC_BIT_SPACE = 4, NEC_REPEAT_MARK = 5};
+
+class NECDecoder {
+    volatile uint8_t *m_input;
+    uint8_t m_mask;
+
+    volatile NECState m_state;
+    volatile bool m_mark;
+    uint8_t m_bits;
+    uint32_t m_data;
+    uint16_t m_previous_edge;
+    volatile uint16_t m_previous_edge_millis;
+
+    volatile uint32_t m_code;
+    volatile bool m_ready;
+
+    volatile uint16_t m_frames;
+    volatile uint16_t m_repeats;
+    volatile uint16_t m_errors;
+
+  public:
+    NECDecoder();
+    void begin(uint8_t pin);
+    void handle_edge();
+    void edge(uint16_t duration, bool mark);
+    bool decode(uint32_t &code);
+    bool is_idle();
+    uint16_t get_frames();
+    uint16_t get_repeats();
+    uint16_t get_errors();
+
+  private:
+    void fail(bool mark);
+    void deliver(uint32_t code);
+};
+
+#endif
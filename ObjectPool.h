@@ -0,0 +1,77 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// A fixed number of short-lived things a pattern draws, e.g. ripples or shooting stars, kept packed at the front of
+// an array so the RAM they take is known up front and never grows. spawn() hands out the next free slot, or NULL
+// when the pool is full, and retire() moves the last live object into the retired one's slot. Both are O(1), and
+// drawing costs one pass over the live objects only.
+//
+// Because retire() moves an object, a loop that retires has to look at the same index again:
+//
+//     for (uint8_t i = 0; i < ripples.size();) {
+//         if (...ripple i is done...) {
+//             ripples.retire(i);
+//             continue;
+//         }
+//         ...draw and advance ripple i...
+//         i++;
+//     }
+//
+// It has no constructor so it can sit in PatternState with everything else, call clear() when the pattern starts.
+template <typename T, uint8_t CAPACITY>
+class ObjectPool {
+    T m_objects[CAPACITY];
+    uint8_t m_size;
+
+  public:
+    void clear() {
+        m_size = 0;
+    }
+
+    T *spawn() {
+        if (m_size == CAPACITY) {
+            return NULL;
+        }
+        return &m_objects[m_size++];
+    }
+
+    void retire(uint8_t i) {
+        m_objects[i] = m_objects[--m_size];
+    }
+
+    uint8_t size() {
+        return m_size;
+    }
+
+    T &operator[](uint8_t i) {
+        return m_objects[i];
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "OutputPipeline.h"
+
+
+// 8 bit channel value to 16 bit light output, gamma 2.2
+static const uint16_t PROGMEM GAMMA16_LUT[256] = {
+    0, 0, 2, 4, 7, 11, 17, 24, 32, 42, 53, 65, 79, 94, 111, 129,
+    148, 169, 192, 216, 242, 270, 299, 330, 362, 396, 432, 469, 508, 549, 591, 635,
+    681, 729, 779, 830, 883, 938, 995, 1053, 1113, 1175, 1239, 1305, 1373, 1443, 1514, 1587,
+    1663, 1740, 1819, 1900, 1983, 2068, 2155, 2243, 2334, 2427, 2521, 2618, 2717, 2817, 2920, 3024,
+    3131, 3240, 3350, 3463, 3578, 3694, 3813, 3934, 4057, 4182, 4309, 4438, 4570, 4703, 4838, 4976,
+    5115, 5257, 5401, 5547, 5695, 5845, 5998, 6152, 6309, 6468, 6629, 6792, 6957, 7124, 7294, 7466,
+    7640, 7816, 7994, 8175, 8358, 8543, 8730, 8919, 9111, 9305, 9501, 9699, 9900, 10102, 10307, 10515,
+    10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254, 12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140,
+    14386, 14635, 14885, 15138, 15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919, 22231, 22546, 22863, 23182,
+    23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826, 26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627,
+    28988, 29351, 29717, 30086, 30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680, 40112, 40546, 40982, 41421,
+    41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025, 45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793,
+    49275, 49761, 50249, 50739, 51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535
+};
+
+// Thresholds for the dithered bits, in bit reversed order so the extra level is spread evenly over the cycle.
+static const uint8_t PROGMEM DITHER_THRESHOLDS[1 << OUTPUT_DITHER_BITS] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+
+OutputPipeline::OutputPipeline(CRGB *rim_leds, CRGB *beam_leds, CRGB *helm_leds) {
+    m_rim_leds = rim_leds;
+    m_beam_leds = beam_leds;
+    m_helm_leds = helm_leds;
+
+    m_checksum = 0;
+    m_stale = true;
+    m_dithering = false;
+    m_dither_phase = 0;
+    m_frame_previous_millis = 0;
+}
+
+
+CRGB *OutputPipeline::get_rim_output_leds() {
+    return m_rim_output_leds;
+}
+
+
+CRGB *OutputPipeline::get_beam_output_leds() {
+    return m_beam_output_leds;
+}
+
+
+CRGB *OutputPipeline::get_helm_output_leds() {
+    return m_helm_output_leds;
+}
+
+
+// Call once per loop. Returns true when the output arrays have been rewritten and need to be shown.
+// allow_dither should be false while nothing may be sent unless it has to be, e.g. while listening for IR.
+bool OutputPipeline::update(uint8_t brightness, bool allow_dither) {
+    uint16_t sum = checksum(brightness);
+    bool dirty = m_stale || (sum != m_checksum);
+    bool dither_due = allow_dither && m_dithering && (millis() - m_frame_previous_millis) >= OUTPUT_DITHER_INTERVAL;
+
+    if (!dirty && !dither_due) {
+        return false;
+    }
+
+    // every frame sent moves the dither on, animated content is dirty almost every frame and would otherwise always
+    // get the same phase
+    m_dither_phase++;
+    m_checksum = sum;
+    m_stale = false;
+    m_dithering = render(brightness);
+    m_frame_previous_millis = millis();
+    return true;
+}
+
+
+// Rewrites the output arrays whether or not anything changed, for when the sketch draws and shows a frame itself.
+void OutputPipeline::refresh(uint8_t brightness) {
+    m_dither_phase++;
+    m_checksum = checksum(brightness);
+    m_stale = false;
+    m_dithering = render(brightness);
+    m_frame_previous_millis = millis();
+}
+
+
+// Call after writing to the output arrays directly (e.g. FastLED.clear()) so the next update() rewrites them.
+void OutputPipeline::invalidate() {
+    m_stale = true;
+}
+
+
+// Fletcher-16 of the source arrays and the brightness
+uint16_t OutputPipeline::checksum(uint8_t brightness) {
+    const CRGB *sources[3] = {m_rim_leds, m_beam_leds, m_helm_leds};
+    const uint16_t lengths[3] = {NUM_RIM_LEDS, NUM_BEAM_LEDS, NUM_HELM_LEDS};
+    uint8_t sum1 = brightness;
+    uint8_t sum2 = brightness;
+
+    for (uint8_t s = 0; s < 3; s++) {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(sources[s]);
+        for (uint16_t i = 0; i < 3*lengths[s]; i++) {
+            sum1 += bytes[i];
+            sum2 += sum1;
+        }
+    }
+
+    return (static_cast<uint16_t>(sum2) << 8) | sum1;
+}
+
+
+// Returns true if any channel was dithered.
+bool OutputPipeline::render(uint8_t brightness) {
+    bool dithering = false;
+    // each strip starts the cycle at a different phase so the beam and helm don't pulse in step with the rim
+    dithering |= render_strip(m_rim_leds, m_rim_output_leds, NUM_RIM_LEDS, brightness, m_dither_phase);
+    dithering |= render_strip(m_beam_leds, m_beam_output_leds, NUM_BEAM_LEDS, brightness, m_dither_phase+3);
+    dithering |= render_strip(m_helm_leds, m_helm_output_leds, NUM_HELM_LEDS, brightness, m_dither_phase+5);
+    return dithering;
+}
+
+
+bool OutputPipeline::render_strip(const CRGB *source, CRGB *output, uint16_t num_leds, uint8_t brightness, uint8_t phase) {
+    const uint8_t mask = (1 << OUTPUT_DITHER_BITS) - 1;
+    bool dithering = false;
+
+    for (uint16_t i = 0; i < num_leds; i++) {
+        // neighbouring pixels are a phase apart so a dithered fade shimmers instead of the whole strip blinking
+        uint8_t threshold = pgm_read_byte(&DITHER_THRESHOLDS[(phase + i) & mask]);
+        for (uint8_t c = 0; c < 3; c++) {
+            uint16_t level = scale16by8(pgm_read_word(&GAMMA16_LUT[source[i].raw[c]]), brightness);
+            uint8_t value = level >> 8;
+            uint8_t fraction = static_cast<uint8_t>(level) >> (8-OUTPUT_DITHER_BITS);
+            if (value < OUTPUT_DITHER_CEILING && fraction != 0) {
+                dithering = true;
+                if (fraction > threshold) {
+                    value++;
+                }
+            }
+            output[i].raw[c] = value;
+        }
+    }
+
+    return dithering;
+}
@@ -0,0 +1,79 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef OUTPUT_PIPELINE_H
+#define OUTPUT_PIPELINE_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// The last stage before the LED strips. Patterns, overlays and FrameStream keep drawing into the usual 8 bit LED arrays.
+// OutputPipeline gamma corrects each channel to 16 bits, applies the brightness at 16 bits and writes the result into
+// its own arrays, which are the ones registered with FastLED. The byte that is sent is the top 8 bits. The bottom bits
+// are temporally dithered, so at the low brightness the strip runs at most of the time a fade moves in steps much
+// finer than one LED level instead of in visible jumps.
+//
+// A frame is only sent when the source arrays or the brightness have changed (the dirty check is a checksum of
+// both), or when some channel is being dithered and OUTPUT_DITHER_INTERVAL has passed since the last frame. Above
+// OUTPUT_DITHER_CEILING one LED level is too small a step to see, so a bright static frame is sent once and left alone.
+//
+// Cost, with 3 bytes per LED for the output arrays and about 40 cycles per channel at 16 MHz:
+//      52 LEDs:  156 bytes RAM, ~0.4 ms per frame on top of the 1.6 ms it takes to send it
+//      83 LEDs:  249 bytes RAM, ~0.6 ms per frame on top of 2.5 ms (this UFO's rim, beam and helm)
+//     300 LEDs:  900 bytes RAM, ~2.3 ms per frame on top of 9.0 ms (too much RAM for a Nano)
+// The 16 bit values are worked out per channel as they are written and never stored, which would take another
+// 3 bytes per LED. The gamma table takes 512 bytes of flash.
+#define OUTPUT_DITHER_BITS 3
+#define OUTPUT_DITHER_INTERVAL 8
+#define OUTPUT_DITHER_CEILING 32
+
+class OutputPipeline {
+    CRGB *m_rim_leds;
+    CRGB *m_beam_leds;
+    CRGB *m_helm_leds;
+
+    CRGB m_rim_output_leds[NUM_RIM_LEDS];
+    CRGB m_beam_output_leds[NUM_BEAM_LEDS];
+    CRGB m_helm_output_leds[NUM_HELM_LEDS];
+
+    uint16_t m_checksum;
+    bool m_stale;
+    bool m_dithering;
+    uint8_t m_dither_phase;
+    uint32_t m_frame_previous_millis;
+
+  public:
+    OutputPipeline(CRGB *rim_leds, CRGB *beam_leds, CRGB *helm_leds);
+    CRGB *get_rim_output_leds();
+    CRGB *get_beam_output_leds();
+    CRGB *get_helm_output_leds();
+    bool update(uint8_t brightness, bool allow_dither);
+    void refresh(uint8_t brightness);
+    void invalidate();
+
+  private:
+    uint16_t checksum(uint8_t brightness);
+    bool render(uint8_t brightness);
+    bool render_strip(const CRGB *source, CRGB *output, uint16_t num_leds, uint8_t brightness, uint8_t phase);
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "Palettes.h"
+
+
+// {index, hue, saturation, value}, one row per palette in the same order as the Palette enum (NO_PALETTE has no row)
+const uint8_t PROGMEM PALETTE_ANCHOR_LUT[NUM_PALETTES-1][PALETTE_ANCHORS][4] = {
+    // HALLOWEEN_PALETTE, the colors halloween_colors_fade() used to build a CRGBPalette16 from every frame
+    {{0, HUE_ORANGE, 255, 255}, {64, HUE_PURPLE, 255, 255}, {128, HUE_RED, 255, 255}, {192, HUE_ALIEN_GREEN, 255, 255}, {255, HUE_ORANGE, 255, 255}},
+    // ALIEN_PALETTE
+    {{0, HUE_ALIEN_GREEN, 255, 255}, {80, HUE_GREEN, 255, 128}, {160, HUE_AQUA, 255, 255}, {208, HUE_YELLOW, 255, 192}, {255, HUE_ALIEN_GREEN, 255, 255}},
+    // FIRE_PALETTE
+    {{0, HUE_RED, 255, 255}, {96, HUE_ORANGE, 255, 255}, {160, HUE_YELLOW, 192, 255}, {208, HUE_ORANGE, 255, 192}, {255, HUE_RED, 255, 255}},
+    // OCEAN_PALETTE
+    {{0, HUE_BLUE, 255, 255}, {80, HUE_AQUA, 255, 255}, {144, HUE_BLUE, 255, 128}, {208, HUE_PURPLE, 255, 192}, {255, HUE_BLUE, 255, 255}}
+};
+
+
+GradientCache::GradientCache() {
+    m_palette = NO_PALETTE;
+    fill_solid(m_gradient, PALETTE_GRADIENT_SIZE, CRGB::Black);
+}
+
+
+// Expands palette into the gradient table. Does nothing if palette is already loaded so it is cheap to call before
+// every use. NO_PALETTE has no gradient and leaves the table as it is.
+void GradientCache::load(Palette palette) {
+    if (palette == m_palette || palette == NO_PALETTE || palette >= NUM_PALETTES) {
+        return;
+    }
+
+    const uint8_t (*anchors)[4] = PALETTE_ANCHOR_LUT[palette-1];
+    uint8_t a = 0; // anchor at the start of the current segment
+
+    CRGB start_color = CHSV(pgm_read_byte(&anchors[0][1]), pgm_read_byte(&anchors[0][2]), pgm_read_byte(&anchors[0][3]));
+    CRGB end_color = CHSV(pgm_read_byte(&anchors[1][1]), pgm_read_byte(&anchors[1][2]), pgm_read_byte(&anchors[1][3]));
+    uint8_t start_index = pgm_read_byte(&anchors[0][0]);
+    uint8_t end_index = pgm_read_byte(&anchors[1][0]);
+
+    for (uint16_t i = 0; i < PALETTE_GRADIENT_SIZE; i++) {
+        uint8_t index = i << PALETTE_INDEX_SHIFT;
+
+        while (index > end_index && a < PALETTE_ANCHORS-2) {
+            a++;
+            start_color = end_color;
+            start_index = end_index;
+            end_color = CHSV(pgm_read_byte(&anchors[a+1][1]), pgm_read_byte(&anchors[a+1][2]), pgm_read_byte(&anchors[a+1][3]));
+            end_index = pgm_read_byte(&anchors[a+1][0]);
+        }
+
+        uint8_t amount = (static_cast<uint16_t>(index - start_index)*255)/(end_index - start_index);
+        m_gradient[i] = blend(start_color, end_color, amount);
+    }
+
+    m_palette = palette;
+}
+
+
+Palette GradientCache::get_palette() {
+    return m_palette;
+}
@@ -0,0 +1,57 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef PALETTES_H
+#define PALETTES_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// A palette is defined in PROGMEM as PALETTE_ANCHORS anchors of {index, hue, saturation, value}. The first anchor
+// must have an index of 0 and the last an index of 255. GradientCache::load() converts the anchors to RGB and
+// linearly blends between them once, so drawing with a palette is a single table lookup per pixel instead of
+// building a CRGBPalette16 and calling ColorFromPalette() every frame.
+// A full 256 entry gradient costs 768 bytes of RAM, which is too much for the Nano, so AVR boards keep every
+// fourth entry instead. Neighbouring entries are so close in color that the difference isn't noticeable.
+#if defined(__AVR__)
+#define PALETTE_INDEX_SHIFT 2
+#else
+#define PALETTE_INDEX_SHIFT 0
+#endif
+#define PALETTE_GRADIENT_SIZE (256 >> PALETTE_INDEX_SHIFT)
+#define PALETTE_ANCHORS 5
+
+class GradientCache {
+    Palette m_palette;
+    CRGB m_gradient[PALETTE_GRADIENT_SIZE];
+
+  public:
+    GradientCache();
+    void load(Palette palette);
+    Palette get_palette();
+
+    inline CRGB color(uint8_t index) const {
+        return m_gradient[index >> PALETTE_INDEX_SHIFT];
+    }
+};
+
+#endif
@@ -0,0 +1,163 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "ParallelOutput.h"
+
+// One bit of all three strips. Cycle 0 sets every strip high, cycle 6 (375 ns) drops the strips sending a 0 and
+// cycle 13 (812 ns) drops the rest, and the bit ends at cycle 20 (1.25 us). In between the mask for the next bit is
+// built from bit `next` of each strip's byte. sbrc followed by ori is two cycles whether it skips or not, so the
+// timing doesn't depend on the data.
+#define PARALLEL_OUTPUT_BIT(next) \
+    "out %[port], %[hi]\n\t" \
+    "rjmp .+0\n\t" \
+    "rjmp .+0\n\t" \
+    "nop\n\t" \
+    "out %[port], %[mask]\n\t" \
+    "mov %[mask], %[lo]\n\t" \
+    "sbrc %[rim], " #next "\n\t" \
+    "ori %[mask], %[rim_bit]\n\t" \
+    "sbrc %[beam], " #next "\n\t" \
+    "ori %[mask], %[beam_bit]\n\t" \
+    "nop\n\t" \
+    "out %[port], %[lo]\n\t" \
+    "sbrc %[helm], " #next "\n\t" \
+    "ori %[mask], %[helm_bit]\n\t" \
+    "rjmp .+0\n\t" \
+    "rjmp .+0\n\t"
+
+// One byte of each strip, most significant bit first. The mask for the first bit is built before it's sent and the
+// last bit builds a mask that's thrown away. test/test_parallel_output.cpp steps through this on the host.
+#define PARALLEL_OUTPUT_BYTE \
+    "mov %[mask], %[lo]\n\t" \
+    "sbrc %[rim], 7\n\t" \
+    "ori %[mask], %[rim_bit]\n\t" \
+    "sbrc %[beam], 7\n\t" \
+    "ori %[mask], %[beam_bit]\n\t" \
+    "sbrc %[helm], 7\n\t" \
+    "ori %[mask], %[helm_bit]\n\t" \
+    PARALLEL_OUTPUT_BIT(6) \
+    PARALLEL_OUTPUT_BIT(5) \
+    PARALLEL_OUTPUT_BIT(4) \
+    PARALLEL_OUTPUT_BIT(3) \
+    PARALLEL_OUTPUT_BIT(2) \
+    PARALLEL_OUTPUT_BIT(1) \
+    PARALLEL_OUTPUT_BIT(0) \
+    PARALLEL_OUTPUT_BIT(0)
+
+
+// The port value of the middle write of bit `bit` (7 is sent first): the strips whose byte has that bit set stay high.
+// This is the transposition send_bytes() does a bit at a time, written out plainly for the host tests to check it by.
+uint8_t parallel_output_mask(uint8_t rim, uint8_t beam, uint8_t helm, uint8_t bit, uint8_t lo) {
+    uint8_t mask = lo;
+    if ((rim >> bit) & 1) {
+        mask |= 1 << PARALLEL_OUTPUT_RIM_BIT;
+    }
+    if ((beam >> bit) & 1) {
+        mask |= 1 << PARALLEL_OUTPUT_BEAM_BIT;
+    }
+    if ((helm >> bit) & 1) {
+        mask |= 1 << PARALLEL_OUTPUT_HELM_BIT;
+    }
+    return mask;
+}
+
+
+#if defined(__AVR__)
+#if F_CPU != 16000000L
+#error "ParallelOutput's bit timing is worked out for 16 MHz"
+#endif
+
+extern volatile unsigned long timer0_millis;
+
+// Sends one byte to each strip, most significant bit first.
+static inline __attribute__((always_inline)) void send_bytes(uint8_t rim, uint8_t beam, uint8_t helm, uint8_t hi, uint8_t lo) {
+    uint8_t mask;
+    asm volatile (
+        PARALLEL_OUTPUT_BYTE
+        : [mask] "=&d" (mask)
+        : [port] "I" (_SFR_IO_ADDR(PARALLEL_OUTPUT_PORT)),
+          [hi] "r" (hi),
+          [lo] "r" (lo),
+          [rim] "r" (rim),
+          [beam] "r" (beam),
+          [helm] "r" (helm),
+          [rim_bit] "M" (_BV(PARALLEL_OUTPUT_RIM_BIT)),
+          [beam_bit] "M" (_BV(PARALLEL_OUTPUT_BEAM_BIT)),
+          [helm_bit] "M" (_BV(PARALLEL_OUTPUT_HELM_BIT))
+    );
+}
+#endif
+
+
+ParallelOutput::ParallelOutput() {
+    m_max_power_mW = 0;
+}
+
+
+// Call alongside FastLED.setMaxPowerInVoltsAndMilliamps(), show() does the power limiting itself.
+void ParallelOutput::set_max_power_in_volts_and_milliamps(uint8_t volts, uint32_t milliamps) {
+    m_max_power_mW = volts * milliamps;
+}
+
+
+// Same as FastLED.show(brightness) but with the strips sent in parallel.
+void ParallelOutput::show(uint8_t brightness) {
+#if defined(__AVR__)
+    if (m_max_power_mW) {
+        brightness = calculate_max_brightness_for_power_mW(brightness, m_max_power_mW);
+    }
+    // the same correction is used for all three, so one controller's adjustment does for all of them
+    CRGB adjustment = FastLED[0].getAdjustment(brightness);
+
+    const CRGB *rim = FastLED[0].leds();
+    const CRGB *beam = FastLED[1].leds();
+    const CRGB *helm = FastLED[2].leds();
+    uint16_t num_rim_leds = FastLED[0].size();
+    uint16_t num_beam_leds = FastLED[1].size();
+    uint16_t num_helm_leds = FastLED[2].size();
+    uint16_t num_leds = max(num_rim_leds, max(num_beam_leds, num_helm_leds));
+
+    // a strip that's shorter than the longest is sent black for the rest, which falls off its end
+    const CRGB black = CRGB::Black;
+
+    uint8_t sreg = SREG;
+    cli();
+    // the other pins on the port keep whatever state they're in
+    uint8_t lo = PARALLEL_OUTPUT_PORT & ~PARALLEL_OUTPUT_MASK;
+    uint8_t hi = lo | PARALLEL_OUTPUT_MASK;
+    for (uint16_t i = 0; i < num_leds; i++) {
+        const CRGB &r = (i < num_rim_leds) ? rim[i] : black;
+        const CRGB &b = (i < num_beam_leds) ? beam[i] : black;
+        const CRGB &h = (i < num_helm_leds) ? helm[i] : black;
+        // GRB order
+        send_bytes(scale8(r.g, adjustment.g), scale8(b.g, adjustment.g), scale8(h.g, adjustment.g), hi, lo);
+        send_bytes(scale8(r.r, adjustment.r), scale8(b.r, adjustment.r), scale8(h.r, adjustment.r), hi, lo);
+        send_bytes(scale8(r.b, adjustment.b), scale8(b.b, adjustment.b), scale8(h.b, adjustment.b), hi, lo);
+    }
+    // same as FastLED, the Timer0 overflows missed while interrupts were off are added back to millis()
+    timer0_millis += 1 + (static_cast<uint32_t>(num_leds)*PARALLEL_OUTPUT_US_PER_LED)/1000;
+    SREG = sreg;
+    delayMicroseconds(50); // latch
+#else
+    (void)brightness;
+#endif
+}
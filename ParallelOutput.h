@@ -0,0 +1,65 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef PARALLEL_OUTPUT_H
+#define PARALLEL_OUTPUT_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Sends the rim, beam and helm at the same time instead of one after another, so a frame takes as long as the rim
+// alone (52 LEDs, ~1.8 ms) instead of all three (83 LEDs, ~2.5 ms). All three data pins have to be on the same port,
+// which on a Nano means moving the rim from pin 2 to pin 9:
+//      helm  pin 8  PB0
+//      rim   pin 9  PB1
+//      beam  pin 10 PB2
+// The strips still have to be registered with FastLED.addLeds() in the order rim, beam, helm. FastLED still owns the
+// power limit and the color correction, and FastLED.show() still works, it just sends them one after another.
+//
+// Each WS2812B bit is three writes to the port: every strip high, then the strips sending a 0 low, then every strip
+// low. The value for the middle write is that bit of all three strips' bytes gathered into one port mask, which is a
+// transpose of the strips' bit planes. Transposing a whole frame up front would take 24 bytes per LED (1.2 KB for the
+// rim), and transposing one LED at a time leaves a gap long enough to latch the strips, so instead the mask for the
+// next bit is built in the idle cycles of the current one. That takes no RAM at all and the only gaps are the couple
+// of microseconds between bytes, where the byte for each strip is loaded and scaled.
+//
+// AVR at 16 MHz only. FastLED's temporal dithering isn't applied.
+#define PARALLEL_OUTPUT_PORT PORTB
+#define PARALLEL_OUTPUT_RIM_BIT 1
+#define PARALLEL_OUTPUT_BEAM_BIT 2
+#define PARALLEL_OUTPUT_HELM_BIT 0
+#define PARALLEL_OUTPUT_MASK (_BV(PARALLEL_OUTPUT_RIM_BIT) | _BV(PARALLEL_OUTPUT_BEAM_BIT) | _BV(PARALLEL_OUTPUT_HELM_BIT))
+// 24 bits of 1.25 us plus the time between bytes, used to catch millis() up after interrupts were off
+#define PARALLEL_OUTPUT_US_PER_LED 33
+
+uint8_t parallel_output_mask(uint8_t rim, uint8_t beam, uint8_t helm, uint8_t bit, uint8_t lo);
+
+class ParallelOutput {
+    uint32_t m_max_power_mW;
+
+  public:
+    ParallelOutput();
+    void set_max_power_in_volts_and_milliamps(uint8_t volts, uint32_t milliamps);
+    void show(uint8_t brightness);
+};
+
+#endif
@@ -0,0 +1,361 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include <EEPROM.h>
+#include "PatternVM.h"
+#include "ReAnimator.h"
+#include "Settings.h"
+#include "FadeKernels.h"
+
+
+static_assert(SETTINGS_EEPROM_ADDRESS + SETTINGS_EEPROM_SLOTS*sizeof(SettingsRecord) <= SCRIPT_EEPROM_ADDRESS, "settings overlap the script in EEPROM");
+static_assert(SCRIPT_EEPROM_ADDRESS + SCRIPT_EEPROM_SIZE <= EEPROM_SIZE, "the script doesn't fit in EEPROM");
+static_assert(SCRIPT_MAX_LENGTH <= UINT8_MAX, "jump addresses are one byte");
+
+
+// r0 = pos, r2 = hue, r3 = value, r4 = number of LEDs
+const uint8_t PROGMEM SCRIPT_ORBIT_PROGRAM[] = {
+    OP_LDI, 0, 0, 0,
+    OP_LDI, 3, 255, 0,
+    OP_LDS, 4, SRC_NUM_LEDS,
+    OP_FRAME,
+    OP_WAIT, 20, 0,
+    OP_FADE, 20,
+    OP_LDS, 2, SRC_RIM_HUE,
+    OP_SET, 0, 2, 3,
+    OP_ADDI, 0, 1,
+    OP_JLT, 0, 4, 35,               // pos < NUM_LEDS, skip the wrap
+    OP_LDI, 0, 0, 0,
+    OP_END                          // 35
+};
+
+// r0 = pos, r1 = delta, r2 = hue, r3 = value, r4 = last LED
+const uint8_t PROGMEM SCRIPT_CYLON_PROGRAM[] = {
+    OP_LDI, 0, 0, 0,
+    OP_LDI, 1, 1, 0,
+    OP_LDS, 4, SRC_NUM_LEDS,
+    OP_ADDI, 4, static_cast<uint8_t>(-1),
+    OP_LDI, 3, 192, 0,
+    OP_FRAME,
+    OP_WAIT, 20, 0,
+    OP_FADE, 20,
+    OP_LDS, 2, SRC_RIM_HUE,
+    OP_ADDPX, 0, 2, 3,
+    OP_ADD, 0, 1,
+    OP_JZ, 0, 41,                   // at the first LED, turn around
+    OP_JLT, 0, 4, 43,               // not at the last LED, keep going
+    OP_NEG, 1,                      // 41
+    OP_END                          // 43
+};
+
+// r0 = pos, r2 = hue, r3 = value, r4 = number of LEDs, r5 = mirrored pos, r7 = step
+const uint8_t PROGMEM SCRIPT_WEAVE_PROGRAM[] = {
+    OP_LDI, 0, 0, 0,
+    OP_LDI, 3, 128, 0,
+    OP_LDS, 4, SRC_NUM_LEDS,
+    OP_LDI, 7, 2, 0,
+    OP_FRAME,
+    OP_WAIT, 60, 0,
+    OP_FADE, 20,
+    OP_LDS, 2, SRC_RIM_HUE,
+    OP_ADDPX, 0, 2, 3,
+    OP_MOV, 5, 4,
+    OP_ADDI, 5, static_cast<uint8_t>(-1),
+    OP_SUB, 5, 0,
+    OP_ADDI, 2, HUE_PURPLE-HUE_ALIEN_GREEN,
+    OP_ADDPX, 5, 2, 3,
+    OP_ADD, 0, 7,
+    OP_MOD, 0, 4,
+    OP_END
+};
+
+const uint8_t * const PROGMEM BUILTIN_SCRIPTS[NUM_BUILTIN_SCRIPTS] = {SCRIPT_ORBIT_PROGRAM, SCRIPT_CYLON_PROGRAM, SCRIPT_WEAVE_PROGRAM};
+const uint8_t PROGMEM BUILTIN_SCRIPT_LENGTHS[NUM_BUILTIN_SCRIPTS] = {sizeof(SCRIPT_ORBIT_PROGRAM), sizeof(SCRIPT_CYLON_PROGRAM), sizeof(SCRIPT_WEAVE_PROGRAM)};
+
+
+PatternVM::PatternVM() {
+    load_builtin(SCRIPT_ORBIT);
+}
+
+
+int8_t PatternVM::load_builtin(BuiltinScript script) {
+    int8_t retval = 0;
+
+    if (script >= NUM_BUILTIN_SCRIPTS) {
+        script = SCRIPT_ORBIT;
+        retval = INT8_MIN;
+    }
+
+    m_program = reinterpret_cast<const uint8_t *>(pgm_read_ptr(&BUILTIN_SCRIPTS[script]));
+    m_length = pgm_read_byte(&BUILTIN_SCRIPT_LENGTHS[script]);
+    m_frame_start = 0;
+
+    return retval;
+}
+
+
+// Switches to the script stored in EEPROM. If there isn't a valid one the current script is kept and INT8_MIN
+// is returned.
+int8_t PatternVM::load_eeprom() {
+    eeprom_begin();
+
+    uint16_t length = EEPROM.read(SCRIPT_EEPROM_ADDRESS) | (EEPROM.read(SCRIPT_EEPROM_ADDRESS+1) << 8);
+    if (length == 0 || length > SCRIPT_MAX_LENGTH) {
+        return INT8_MIN;
+    }
+
+    uint8_t crc = 0;
+    for (uint16_t i = 0; i < length; i++) {
+        crc = crc8_update(crc, EEPROM.read(SCRIPT_EEPROM_ADDRESS+SCRIPT_HEADER_SIZE+i));
+    }
+    if (crc != EEPROM.read(SCRIPT_EEPROM_ADDRESS+2)) {
+        return INT8_MIN;
+    }
+
+    m_program = NULL;
+    m_length = length;
+    m_frame_start = 0;
+
+    return 0;
+}
+
+
+// Bytes past the end of the script read as OP_END so a truncated instruction ends the frame.
+uint8_t PatternVM::fetch(uint8_t pc) {
+    if (pc >= m_length) {
+        return OP_END;
+    }
+
+    if (m_program == NULL) {
+        return EEPROM.read(SCRIPT_EEPROM_ADDRESS+SCRIPT_HEADER_SIZE+pc);
+    }
+
+    return pgm_read_byte(m_program + pc);
+}
+
+
+void PatternVM::run(ReAnimator &r, bool restart, uint16_t(ReAnimator::*dfp)(uint16_t)) {
+    uint16_t *reg = m_registers;
+    uint8_t pc = m_frame_start;
+
+    if (restart) {
+        memset(m_registers, 0, sizeof(m_registers));
+        m_frame_start = 0;
+        pc = 0;
+    }
+
+    for (uint8_t steps = 0; steps < SCRIPT_MAX_STEPS; steps++) {
+        if (pc >= m_length) {
+            return;
+        }
+
+        uint8_t op = fetch(pc++);
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint8_t c = 0;
+
+        switch(op) {
+            default:
+            case OP_END:
+                return;
+            case OP_FRAME:
+                m_frame_start = pc;
+                break;
+            case OP_WAIT:
+                a = fetch(pc++);
+                b = fetch(pc++);
+                if (!r.is_wait_over(a | (b << 8))) {
+                    return;
+                }
+                break;
+            case OP_LDI:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++);
+                c = fetch(pc++);
+                reg[a] = b | (c << 8);
+                break;
+            case OP_LDS:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++);
+                switch(b) {
+                    default:
+                    case SRC_NUM_LEDS:
+                        reg[a] = r.num_leds;
+                        break;
+                    case SRC_RIM_HUE:
+                        reg[a] = r.rim_hue(); // with the hue modulator applied, like the built-in patterns
+                        break;
+                    case SRC_BEAM_HUE:
+                        reg[a] = *r.selected_beam_hue;
+                        break;
+                    case SRC_SOUND:
+                        reg[a] = r.sound_value;
+                        break;
+                    case SRC_MILLIS:
+                        reg[a] = millis();
+                        break;
+                    case SRC_RANDOM:
+                        reg[a] = random16();
+                        break;
+                }
+                break;
+            case OP_MOV:
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MOD:
+            case OP_RAND:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++) & 0x07;
+                if (op == OP_MOV) {
+                    reg[a] = reg[b];
+                }
+                else if (op == OP_ADD) {
+                    reg[a] += reg[b];
+                }
+                else if (op == OP_SUB) {
+                    reg[a] -= reg[b];
+                }
+                else if (op == OP_MOD) {
+                    if (reg[b] != 0) {
+                        reg[a] %= reg[b];
+                    }
+                }
+                else {
+                    reg[a] = random16(reg[b]);
+                }
+                break;
+            case OP_ADDI:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++);
+                reg[a] += static_cast<int8_t>(b);
+                break;
+            case OP_NEG:
+                a = fetch(pc++) & 0x07;
+                reg[a] = -reg[a];
+                break;
+            case OP_FADE:
+                fade_leds(r.rim_leds, r.num_leds, fetch(pc++));
+                break;
+            case OP_FILL:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++) & 0x07;
+                fill_solid(r.rim_leds, r.num_leds, r.hue_color(reg[a], reg[b]));
+                break;
+            case OP_SET:
+            case OP_ADDPX:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++) & 0x07;
+                c = fetch(pc++) & 0x07;
+                if (op == OP_SET) {
+                    r.rim_leds[(r.*dfp)(reg[a] % r.num_leds)] = r.hue_color(reg[b], reg[c]);
+                }
+                else {
+                    r.rim_leds[(r.*dfp)(reg[a] % r.num_leds)] += r.hue_color(reg[b], reg[c]);
+                }
+                break;
+            case OP_SHIFT:
+                for (uint16_t i = r.num_leds-1; i > 0; i--) {
+                    r.rim_leds[(r.*dfp)(i)] = r.rim_leds[(r.*dfp)(i-1)];
+                }
+                break;
+            case OP_CLEAR:
+                fill_solid(r.rim_leds, r.num_leds, CRGB::Black);
+                break;
+            case OP_JMP:
+                pc = fetch(pc);
+                break;
+            case OP_JZ:
+            case OP_JNZ:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++);
+                if ((reg[a] == 0) == (op == OP_JZ)) {
+                    pc = b;
+                }
+                break;
+            case OP_JLT:
+                a = fetch(pc++) & 0x07;
+                b = fetch(pc++) & 0x07;
+                c = fetch(pc++);
+                if (reg[a] < reg[b]) {
+                    pc = c;
+                }
+                break;
+        }
+    }
+}
+
+
+ScriptUploader::ScriptUploader() {
+    m_received = 0;
+    m_length = 0;
+    m_crc = 0;
+}
+
+
+// Returns true once a complete script with a good CRC has been stored in EEPROM.
+// The header is written last, so an upload that fails part way leaves a header whose CRC no longer matches and
+// load_eeprom() refuses the half written script.
+bool ScriptUploader::service(HardwareSerial &serial) {
+    while (serial.available() > 0) {
+        uint8_t b = serial.read();
+
+        if (m_received == 0) {
+            m_received = (b == 'P') ? 1 : 0;
+        }
+        else if (m_received == 1) {
+            m_received = (b == 'S') ? 2 : ((b == 'P') ? 1 : 0);
+        }
+        else if (m_received == 2) {
+            if (b == 0 || b > SCRIPT_MAX_LENGTH) {
+                serial.write(0x15);
+                m_received = 0;
+            }
+            else {
+                m_length = b;
+                m_crc = 0;
+                m_received++;
+            }
+        }
+        else if (m_received < m_length+3) {
+            eeprom_update(SCRIPT_EEPROM_ADDRESS+SCRIPT_HEADER_SIZE+(m_received-3), b);
+            m_crc = crc8_update(m_crc, b);
+            m_received++;
+            serial.write(b);
+        }
+        else {
+            m_received = 0;
+            if (b != m_crc) {
+                serial.write(0x15);
+                continue;
+            }
+
+            eeprom_update(SCRIPT_EEPROM_ADDRESS+2, m_crc);
+            eeprom_update(SCRIPT_EEPROM_ADDRESS+1, 0);
+            eeprom_update(SCRIPT_EEPROM_ADDRESS, m_length);
+            eeprom_commit();
+            serial.write(0x06);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,110 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef PATTERN_VM_H
+#define PATTERN_VM_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// A tiny interpreter for pattern scripts, so new patterns can be added by writing bytes to EEPROM (or uploading
+// them over serial) instead of spending flash and reflashing. Scripts draw with the same primitives the built-in
+// patterns use (fade_leds(), hue_color(), is_wait_over() and the current direction).
+//
+// A script has an init section followed by FRAME and a per-frame section. When the SCRIPT pattern starts the init
+// section runs from byte 0, then every frame runs from the instruction after FRAME until END. WAIT ends the frame
+// early if its interval hasn't elapsed, which is how scripts get their speed. A frame may execute at most
+// SCRIPT_MAX_STEPS instructions, so a runaway loop can't stall the IR receiver or the LEDs. Running off the end of
+// the script or hitting an unknown opcode ends the frame.
+//
+// Operands are one byte each: a register number (0-7, registers are 16 bits), an immediate, or an absolute jump
+// address within the script. 16 bit immediates are little endian.
+//     END                       end this frame
+//     FRAME                     start of the per-frame section
+//     WAIT     ms16             end this frame unless ms16 has elapsed since the last draw
+//     LDI      rd, imm16        rd = imm16
+//     LDS      rd, source       rd = a ScriptSource value (e.g. the number of LEDs or the selected hue)
+//     MOV      rd, rs           rd = rs
+//     ADD      rd, rs           rd = rd + rs
+//     SUB      rd, rs           rd = rd - rs
+//     ADDI     rd, simm8        rd = rd + simm8 (-128 to 127)
+//     MOD      rd, rs           rd = rd % rs (rd is left alone if rs is 0)
+//     RAND     rd, rs           rd = random number from 0 to rs-1
+//     NEG      rd               rd = -rd
+//     FADE     imm8             fade the rim toward black by imm8/256
+//     FILL     rh, rv           fill the rim with hue rh at value rv
+//     SET      rp, rh, rv       LED rp (modulo the rim length, in the current direction) = hue rh at value rv
+//     ADDPX    rp, rh, rv       same as SET but adds to the LED's color
+//     SHIFT                     move every LED one step in the current direction
+//     CLEAR                     turn the rim off
+//     JMP      addr             jump to addr
+//     JZ       rs, addr         jump to addr if rs is 0
+//     JNZ      rs, addr         jump to addr if rs is not 0
+//     JLT      ra, rb, addr     jump to addr if ra < rb (unsigned)
+enum ScriptOp {OP_END = 0, OP_FRAME = 1, OP_WAIT = 2, OP_LDI = 3, OP_LDS = 4, OP_MOV = 5, OP_ADD = 6, OP_SUB = 7,
+               OP_ADDI = 8, OP_MOD = 9, OP_RAND = 10, OP_NEG = 11, OP_FADE = 12, OP_FILL = 13, OP_SET = 14,
+               OP_ADDPX = 15, OP_SHIFT = 16, OP_CLEAR = 17, OP_JMP = 18, OP_JZ = 19, OP_JNZ = 20, OP_JLT = 21};
+enum ScriptSource {SRC_NUM_LEDS = 0, SRC_RIM_HUE = 1, SRC_BEAM_HUE = 2, SRC_SOUND = 3, SRC_MILLIS = 4, SRC_RANDOM = 5};
+
+#define SCRIPT_NUM_REGISTERS 8
+#define SCRIPT_MAX_STEPS 128
+// The EEPROM script is stored as its length (2 bytes), a CRC-8 of the script, then the script itself.
+#define SCRIPT_HEADER_SIZE 3
+#define SCRIPT_MAX_LENGTH (SCRIPT_EEPROM_SIZE-SCRIPT_HEADER_SIZE)
+
+// ORBIT, CYLON and WEAVE written as scripts, mostly as examples
+enum BuiltinScript {SCRIPT_ORBIT = 0, SCRIPT_CYLON = 1, SCRIPT_WEAVE = 2};
+#define NUM_BUILTIN_SCRIPTS 3
+
+class ReAnimator;
+
+class PatternVM {
+    const uint8_t *m_program; // PROGMEM, or NULL when the script is in EEPROM
+    uint8_t m_length;
+    uint8_t m_frame_start;
+    uint16_t m_registers[SCRIPT_NUM_REGISTERS];
+
+  public:
+    PatternVM();
+    int8_t load_builtin(BuiltinScript script);
+    int8_t load_eeprom();
+    void run(ReAnimator &r, bool restart, uint16_t(ReAnimator::*dfp)(uint16_t));
+
+  private:
+    uint8_t fetch(uint8_t pc);
+};
+
+// Receives a script over serial and stores it in EEPROM.
+// Upload: 'P' 'S', length (1 byte), the script, CRC-8 of the script. Each script byte is echoed back once it has
+// been written to EEPROM and the host must wait for the echo before sending the next byte, because an EEPROM
+// write takes longer than a byte takes to arrive. A final 0x06 means the script was stored, 0x15 means it was rejected.
+class ScriptUploader {
+    uint16_t m_received; // counts the 3 header bytes too, so a SCRIPT_MAX_LENGTH script needs more than 8 bits
+    uint8_t m_length;
+    uint8_t m_crc;
+
+  public:
+    ScriptUploader();
+    bool service(HardwareSerial &serial);
+};
+
+#endif
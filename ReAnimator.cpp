@@ -21,18 +21,46 @@
 */
 
 #include "ReAnimator.h"
+#include "FadeKernels.h"
 
 
-ReAnimator::ReAnimator(CRGB rim_leds_in[NUM_RIM_LEDS], CRGB beam_leds_in[NUM_BEAM_LEDS], CRGB helm_leds_in[NUM_HELM_LEDS], uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps) : freezer(*this) {
-    rim_leds = rim_leds_in;
+ReAnimator::ReAnimator(CRGB rim_leds_in[NUM_RIM_LEDS], CRGB beam_leds_in[NUM_BEAM_LEDS], CRGB helm_leds_in[NUM_HELM_LEDS], ReAnimatorLayers<NUM_RIM_LEDS> &layers, uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps)
+    : ReAnimator(Span{rim_leds_in, NUM_RIM_LEDS, 1, 0}, layers.buffers(), beam_leds_in, helm_leds_in, rim_hue_type, beam_hue_type, led_strip_milliamps) {
+}
+
+
+ReAnimator::ReAnimator(Span strip, LayerBuffers layers, CRGB *beam_leds_in, CRGB *helm_leds_in, uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps) : freezer(*this) {
+    rim_output_leds = strip.leds;
+    num_leds = min(strip.length, layers.length);
+    output_direction = (strip.direction < 0) ? -1 : 1;
+    geometry_offset = strip.geometry_offset;
+#if SEPARATE_PATTERN_LAYER
+    rim_pattern_leds = layers.pattern;
+    rim_leds = rim_pattern_leds;
+#else
+    rim_leds = rim_output_leds;
+    output_flipped = false;
+#endif
+    fill_solid(rim_leds, num_leds, CRGB::Black);
+#if RENDER_LAYERS
+    rim_overlay_leds = layers.overlay;
+    fill_solid(rim_overlay_leds, num_leds, CRGB::Black);
+#endif
     beam_leds = beam_leds_in;
     helm_leds = helm_leds_in;
 
     selected_rim_hue = rim_hue_type;
     selected_beam_hue = beam_hue_type;
+    palette = NO_PALETTE;
+    hue_cache_stale = true;
     selected_led_strip_milliamps = led_strip_milliamps;
 
     homogenized_brightness = 255;
+    brightness_cache = NULL;
+
+    pattern_layer_brightness = 255;
+    overlay_layer_brightness = 255;
+    overlay_blend_mode = BLEND_ADD;
 
     pattern = ORBIT;
     transient_overlay = NO_OVERLAY;
@@ -49,6 +77,35 @@ ReAnimator::ReAnimator(CRGB rim_leds_in[NUM_RIM_LEDS], CRGB beam_leds_in[NUM_BEA
     reverse = false;
 
     last_pattern_ran = NULL;
+    pattern_previous_millis = 0;
+
+    // every pattern sets up its own state when it starts, except that last_pattern_ran starts out as ORBIT
+    memset(&pattern_state, 0, sizeof(pattern_state));
+    pattern_state.orbit.pos = num_leds;
+
+    leader = NULL;
+    draw_ticks = 0;
+
+    clock_offset = 0;
+
+    overlay_previous_millis = 0;
+    glitter_previous_millis = 0;
+    breathing_delta = 0;
+    flicker_on = true;
+
+    helm_previous_millis = 0;
+    tractor_beam_pos = 0;
+    tractor_beam_delta = 1;
+    tractor_beam_cycles = 0;
+    tractor_beam_previous_millis = 0;
+
+#if CROSSFADE_TRANSITIONS
+    rim_transition_leds = layers.transition;
+    fill_solid(rim_transition_leds, num_leds, CRGB::Black);
+    transition_active = false;
+    transition_progress = 255;
+    transition_previous_millis = 0;
+#endif
 
     autocycle_enabled = false;
     autocycle_previous_millis = 0;
@@ -58,6 +115,9 @@ ReAnimator::ReAnimator(CRGB rim_leds_in[NUM_RIM_LEDS], CRGB beam_leds_in[NUM_BEA
     flipflop_previous_millis = 0;
     flipflop_interval = 6000;
 
+    transition_interval = 1000;
+
+    sample_sum = 0;
     previous_sample = 0;
     sample_peak = 0;
     sample_average = 0;
@@ -69,6 +129,11 @@ ReAnimator::ReAnimator(CRGB rim_leds_in[NUM_RIM_LEDS], CRGB beam_leds_in[NUM_BEA
 ReAnimator::Freezer::Freezer(ReAnimator &r) : parent(r) {
     m_frozen = false;
     m_frozen_previous_millis = 0;
+    m_lit_pixels = NUM_RIM_LEDS;
+    m_timer_started = false;
+    m_timer_previous_millis = 0;
+    m_all_black = false;
+    m_frozen_duration = m_failsafe_timeout;
 }
 
 
@@ -79,13 +144,71 @@ ReAnimator::Freezer::Freezer(ReAnimator &r) : parent(r) {
 // brightness level. This will lead to dimmer animations and power usage almost always a good bit lower than what the FastLED power
 // management function was set to aim for. Set the #define for HOMOGENIZE_BRIGHTNESS to false to disable this feature.
 void ReAnimator::homogenize_brightness() {
-    uint8_t max_brightness = calculate_max_brightness_for_power_vmA(rim_leds, NUM_RIM_LEDS, homogenized_brightness, LED_STRIP_VOLTAGE, selected_led_strip_milliamps);
+    uint8_t max_brightness = calculate_max_brightness_for_power_vmA(rim_output_leds, num_leds, homogenized_brightness, LED_STRIP_VOLTAGE, selected_led_strip_milliamps);
     if (max_brightness < homogenized_brightness) {
         homogenized_brightness = max_brightness;
     }
 }
 
 
+// Lets homogenize_brightness() start from what was learned about each pattern in earlier power cycles. Only one
+// ReAnimator should have a cache, the table is for a single fixture.
+void ReAnimator::set_brightness_cache(BrightnessCache *cache) {
+    brightness_cache = cache;
+    if (brightness_cache != NULL) {
+        homogenized_brightness = brightness_cache->get_brightness(selected_led_strip_milliamps, HOMOGENIZE_PER_PATTERN);
+    }
+}
+
+
+// See Modulation.h. Returns -1 if slot doesn't exist or PATTERN_MODULATION is false.
+int8_t ReAnimator::set_modulator(uint8_t slot, ModSource source, ModTarget target, int8_t depth, uint16_t period) {
+#if PATTERN_MODULATION
+    return modulation.set(slot, source, target, depth, period);
+#else
+    (void)slot;
+    (void)source;
+    (void)target;
+    (void)depth;
+    (void)period;
+    return -1;
+#endif
+}
+
+
+void ReAnimator::clear_modulators() {
+#if PATTERN_MODULATION
+    modulation.clear();
+#endif
+}
+
+
+// homogenize_brightness() for the patterns' own frames. With a cache the brightness comes from the most power the
+// running pattern (or any pattern) has been seen to draw, so it is right from the first frame and it doesn't have
+// to be relearned when the milliamps go up.
+void ReAnimator::homogenize_pattern_brightness() {
+    if (brightness_cache == NULL) {
+        homogenize_brightness();
+        return;
+    }
+
+    bool learning = true;
+#if CROSSFADE_TRANSITIONS
+    learning = !transition_active; // a cross-fade's frames are partly the outgoing pattern
+#endif
+    if (learning) {
+        // the pattern's own pixels, BREATHING and FLICKER only ever dim them and the cache is for full brightness
+        brightness_cache->learn(pattern, calculate_unscaled_power_mW(rim_leds, num_leds));
+    }
+    homogenized_brightness = brightness_cache->get_brightness(selected_led_strip_milliamps, HOMOGENIZE_PER_PATTERN);
+}
+
+
+uint8_t *ReAnimator::get_selected_rim_hue() {
+    return selected_rim_hue;
+}
+
+
 void ReAnimator::set_selected_rim_hue(uint8_t *hue_type) {
     selected_rim_hue = hue_type;
 }
@@ -96,14 +219,47 @@ void ReAnimator::set_selected_beam_hue(uint8_t *hue_type) {
 }
 
 
+Palette ReAnimator::get_palette() {
+    return palette;
+}
+
+
+void ReAnimator::set_palette(Palette palette_in) {
+    if (palette_in >= NUM_PALETTES) {
+        palette_in = NO_PALETTE;
+    }
+    palette = palette_in;
+    gradient.load(palette);
+    hue_cache_stale = true;
+}
+
+
+// The color every pattern uses for the selected hues. Without a palette this is the same as CHSV(hue, 255, value).
+// With a palette the hue picks a color out of the gradient, which is then dimmed the same way hsv2rgb_rainbow()
+// dims a CHSV (i.e. by value squared) so patterns look the same whether or not a palette is selected.
+CRGB ReAnimator::hue_color(uint8_t hue, uint8_t value) {
+    if (palette == NO_PALETTE) {
+        return CHSV(hue, 255, value);
+    }
+
+    return scale_by_value(gradient.color(hue), value);
+}
+
+
 void ReAnimator::set_selected_led_strip_milliamps(uint16_t led_strip_milliamps) {
+    if (brightness_cache != NULL) {
+        selected_led_strip_milliamps = led_strip_milliamps;
+        homogenized_brightness = brightness_cache->get_brightness(led_strip_milliamps, HOMOGENIZE_PER_PATTERN);
+        return;
+    }
+
     if (led_strip_milliamps > selected_led_strip_milliamps) {
         // normally homogenized_brightness only goes down but since the power is increased we need to reset homogenized_brightness so it
         // learn the new brightness level that makes all the animations have a consistent brightness
-        homogenized_brightness = calculate_max_brightness_for_power_vmA(rim_leds, NUM_RIM_LEDS, 255, LED_STRIP_VOLTAGE, led_strip_milliamps);
+        homogenized_brightness = calculate_max_brightness_for_power_vmA(rim_output_leds, num_leds, 255, LED_STRIP_VOLTAGE, led_strip_milliamps);
     }
     else {
-        homogenized_brightness = calculate_max_brightness_for_power_vmA(rim_leds, NUM_RIM_LEDS, homogenized_brightness, LED_STRIP_VOLTAGE, led_strip_milliamps);
+        homogenized_brightness = calculate_max_brightness_for_power_vmA(rim_output_leds, num_leds, homogenized_brightness, LED_STRIP_VOLTAGE, led_strip_milliamps);
     }
     selected_led_strip_milliamps = led_strip_milliamps;
 }
@@ -174,9 +330,9 @@ int8_t ReAnimator::set_pattern(Pattern pattern_in, bool reverse_in, bool disable
             overlay_out = NO_OVERLAY;
             break;
         case MATRIX:
-            //FastLED[0].clearLeds(NUM_RIM_LEDS); // this doesn't seem to work
+            //FastLED[0].clearLeds(num_leds); // this doesn't seem to work
             //FastLED[0].clearLedData();  // this works but I don't want to use multiple controllers
-            fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black); // clear once before starting
+            fill_solid(rim_leds, num_leds, CRGB::Black); // clear once before starting
             pattern_out = MATRIX;
             overlay_out = NO_OVERLAY;
             break;
@@ -224,6 +380,24 @@ int8_t ReAnimator::set_pattern(Pattern pattern_in, bool reverse_in, bool disable
             pattern_out = DYNAMIC_RAINBOW;
             overlay_out = NO_OVERLAY;
             break;
+#if PATTERN_SCRIPTS
+        case SCRIPT:
+            pattern_out = SCRIPT;
+            overlay_out = NO_OVERLAY;
+            break;
+#endif
+        case VERTICAL_SWEEP:
+            pattern_out = VERTICAL_SWEEP;
+            overlay_out = NO_OVERLAY;
+            break;
+        case ROTATIONAL_SWEEP:
+            pattern_out = ROTATIONAL_SWEEP;
+            overlay_out = NO_OVERLAY;
+            break;
+        case RADIAL_SWEEP:
+            pattern_out = RADIAL_SWEEP;
+            overlay_out = NO_OVERLAY;
+            break;
     }
 
     pattern = pattern_out;
@@ -240,13 +414,22 @@ int8_t ReAnimator::set_pattern(Pattern pattern_in, bool reverse_in, bool disable
 }
 
 
+bool ReAnimator::get_reverse() {
+    return reverse;
+}
+
+
 int8_t ReAnimator::increment_pattern() {
     return increment_pattern(true);
 }
 
 
 int8_t ReAnimator::increment_pattern(bool disable_autocycle_flipflop) {
-    return set_pattern(pattern+1, reverse, disable_autocycle_flipflop);
+    uint8_t next = pattern+1;
+    while (next < NUM_PATTERNS && !has_pattern(static_cast<Pattern>(next))) {
+        next++; // e.g. SCRIPT when PATTERN_SCRIPTS is false
+    }
+    return set_pattern(next, reverse, disable_autocycle_flipflop);
 }
 
 
@@ -295,6 +478,8 @@ int8_t ReAnimator::set_overlay(Overlay overlay_in, bool is_persistent) {
         transient_overlay = overlay_out;
     }
 
+    select_overlay_blend_mode();
+
     return retval;
 }
 
@@ -337,10 +522,17 @@ void ReAnimator::set_autocycle_enabled(bool enabled) {
 
 
 // loop through all of the patterns
+// these patterns light the whole fixture, so helm() and tractor_beam() stay out of their way
+bool ReAnimator::draws_beam_and_helm(Pattern pattern) {
+    return (pattern == VERTICAL_SWEEP || pattern == ROTATIONAL_SWEEP || pattern == RADIAL_SWEEP);
+}
+
+
 void ReAnimator::autocycle() {
     if((millis() - autocycle_previous_millis) > autocycle_interval) {
         autocycle_previous_millis = millis();
         DEBUG_PRINTLN("autocycle started");
+        begin_transition();
         if (increment_pattern(false) == INT8_MIN) {
             // autocycle has looped back around to the first pattern so reverse them
             reverse = !reverse;
@@ -376,12 +568,189 @@ void ReAnimator::flipflop() {
     if((millis() - flipflop_previous_millis) > flipflop_interval) {
         flipflop_previous_millis = millis();
         DEBUG_PRINTLN("flip flop loop started");
+        begin_transition();
         reverse = !reverse;
     }
 }
 
 
+// The script is restarted from its init section the next time the SCRIPT pattern runs.
+int8_t ReAnimator::load_builtin_script(BuiltinScript script) {
+#if PATTERN_SCRIPTS
+    last_pattern_ran = NULL;
+    return script_vm.load_builtin(script);
+#else
+    (void)script;
+    return INT8_MIN;
+#endif
+}
+
+
+int8_t ReAnimator::load_eeprom_script() {
+#if PATTERN_SCRIPTS
+    last_pattern_ran = NULL;
+    return script_vm.load_eeprom();
+#else
+    return INT8_MIN;
+#endif
+}
+
+
+uint16_t ReAnimator::get_transition_interval() {
+    return transition_interval;
+}
+
+
+void ReAnimator::set_transition_interval(uint16_t interval) {
+    transition_interval = interval;
+}
+
+
+// Must be called before pattern or reverse is changed so the outgoing frame can be saved.
+// set_pattern() may clear the pattern layer (e.g. MATRIX) so the copy has to be taken first.
+void ReAnimator::begin_transition() {
+#if CROSSFADE_TRANSITIONS
+    memcpy(rim_transition_leds, rim_leds, num_leds*sizeof(CRGB));
+#if CROSSFADE_RENDER_OUTGOING
+    outgoing_pattern = pattern;
+    outgoing_reverse = reverse;
+    outgoing_last_pattern_ran = last_pattern_ran;
+    outgoing_previous_millis = pattern_previous_millis;
+    outgoing_accelerate_decelerate = pattern_state.accelerate_decelerate;
+#endif
+    transition_active = true;
+    transition_progress = 0;
+    transition_previous_millis = millis();
+#endif
+}
+
+
+void ReAnimator::update_transition() {
+#if CROSSFADE_TRANSITIONS
+    if (transition_active) {
+        uint32_t elapsed = millis() - transition_previous_millis;
+        if (elapsed >= transition_interval) {
+            transition_active = false;
+            transition_progress = 255;
+        }
+        else {
+            transition_progress = (elapsed*255)/transition_interval;
+        }
+    }
+#endif
+}
+
+
+#if CROSSFADE_TRANSITIONS && CROSSFADE_RENDER_OUTGOING
+// Swap the outgoing pattern's state in, draw it into the scratch buffer, then swap the incoming pattern back.
+// flipflop only changes reverse, so the outgoing and incoming patterns would share the same pattern_state. In that
+// case the outgoing frame is left frozen like it is when CROSSFADE_RENDER_OUTGOING is false.
+// THEATER_CHASE and RUNNING_LIGHTS share accelerate_decelerate, so it is swapped along with the rest.
+void ReAnimator::render_outgoing() {
+    if (outgoing_pattern == pattern) {
+        return;
+    }
+
+    CRGB *incoming_leds = rim_leds;
+    Pattern incoming_pattern = pattern;
+    bool incoming_reverse = reverse;
+    Pattern incoming_last_pattern_ran = last_pattern_ran;
+    uint32_t incoming_previous_millis = pattern_previous_millis;
+    uint8_t incoming_draw_ticks = draw_ticks;
+    PatternState::AccelerateDecelerate incoming_accelerate_decelerate = pattern_state.accelerate_decelerate;
+
+    rim_leds = rim_transition_leds;
+    pattern = outgoing_pattern;
+    reverse = outgoing_reverse;
+    last_pattern_ran = outgoing_last_pattern_ran;
+    pattern_previous_millis = outgoing_previous_millis;
+    pattern_state.accelerate_decelerate = outgoing_accelerate_decelerate;
+
+    run_pattern(pattern);
+
+    outgoing_last_pattern_ran = pattern;
+    outgoing_previous_millis = pattern_previous_millis;
+    outgoing_accelerate_decelerate = pattern_state.accelerate_decelerate;
+    pattern_state.accelerate_decelerate = incoming_accelerate_decelerate;
+
+    rim_leds = incoming_leds;
+    pattern = incoming_pattern;
+    reverse = incoming_reverse;
+    last_pattern_ran = incoming_last_pattern_ran;
+    pattern_previous_millis = incoming_previous_millis;
+    draw_ticks = incoming_draw_ticks; // the outgoing pattern's draws shouldn't tick the followers
+}
+#endif
+
+
+// Phase-lock this ReAnimator to another one. A follower runs whatever pattern and direction its leader runs and only
+// draws when its leader draws, so fixtures running the same deterministic pattern stay in step. Pass NULL to run freely.
+void ReAnimator::follow(ReAnimator *leader_in) {
+    if (leader_in == this) {
+        leader_in = NULL;
+    }
+    leader = leader_in;
+    if (leader != NULL) {
+        draw_ticks = leader->draw_ticks;
+    }
+}
+
+
+// Switch to a pattern picked by another ReAnimator or controller. Nothing happens unless the pattern or direction
+// actually changed. This turns off autocycle and flipflop because the other side decides when to change.
+// A pattern this build doesn't have (e.g. SCRIPT when PATTERN_SCRIPTS is false) is ignored. set_pattern() would run
+// ORBIT instead, which never matches the other side's pattern, so every packet would start another cross-fade.
+void ReAnimator::follow_pattern(Pattern pattern_in, bool reverse_in) {
+    if (!has_pattern(pattern_in)) {
+        return;
+    }
+
+    if (pattern_in != pattern || reverse_in != reverse) {
+        begin_transition();
+        set_pattern(pattern_in, reverse_in, true);
+    }
+}
+
+
+bool ReAnimator::has_pattern(Pattern pattern_in) {
+#if !PATTERN_SCRIPTS
+    if (pattern_in == SCRIPT) {
+        return false;
+    }
+#endif
+    return (pattern_in < NUM_PATTERNS);
+}
+
+
+uint32_t ReAnimator::now() {
+    return millis() + clock_offset;
+}
+
+
+int32_t ReAnimator::get_clock_offset() {
+    return clock_offset;
+}
+
+
+void ReAnimator::set_clock_offset(int32_t offset) {
+    clock_offset = offset;
+}
+
+
+uint8_t ReAnimator::get_homogenized_brightness() {
+    return homogenized_brightness;
+}
+
+
 void ReAnimator::reanimate() {
+#ifdef UFO_DEBUG
+    uint32_t frame_start_micros = micros();
+#endif
+
+    if (leader != NULL) {
+        follow_pattern(leader->pattern, leader->reverse);
+    }
+
     if (autocycle_enabled) {
         autocycle();
     }
@@ -392,26 +761,73 @@ void ReAnimator::reanimate() {
 
     process_sound();
 
+#if PATTERN_MODULATION
+    modulation.update(now(), sound_value, sample_peak);
+#endif
+
+    refresh_hue_cache();
+
+    update_transition();
+
+#if !SEPARATE_PATTERN_LAYER
+    // patterns read back what they drew last frame, not what was shown
+    if (output_flipped) {
+        flip_output();
+    }
+#endif
+
     if (!freezer.is_frozen()) {
+#if CROSSFADE_TRANSITIONS && CROSSFADE_RENDER_OUTGOING
+        // a follower's outgoing pattern would use up the leader's draw tick meant for the incoming pattern
+        if (transition_active && leader == NULL) {
+            render_outgoing();
+        }
+#endif
         run_pattern(pattern);
         last_pattern_ran = pattern;
     }
 
+    // the brightness overlays set these every frame they run
+    pattern_layer_brightness = 255;
+    overlay_layer_brightness = 255;
+
     apply_overlay(transient_overlay);
     apply_overlay(persistent_overlay);
 
-    helm(200);
-    tractor_beam(25);
+    composite();
+
+    if (!draws_beam_and_helm(pattern)) {
+        if (helm_leds != NULL) {
+            helm(200);
+        }
+        if (beam_leds != NULL) {
+            tractor_beam(25);
+        }
+    }
 
     //print_dt();
 
 #if HOMOGENIZE_BRIGHTNESS
-    homogenize_brightness();
+    homogenize_pattern_brightness();
+#endif
+
+#if SEPARATE_PATTERN_LAYER
+    // BREATHING and FLICKER scale the pattern layer in composite() so they no longer need to fight over the global brightness
+    FastLED.setBrightness(homogenized_brightness);
+#else
+    // with no pattern layer to scale, BREATHING and FLICKER scale the global brightness instead
+    FastLED.setBrightness(scale8(homogenized_brightness, pattern_layer_brightness));
 #endif
 
-    if (transient_overlay != BREATHING && transient_overlay != FLICKER && persistent_overlay != BREATHING && persistent_overlay != FLICKER) {
-        FastLED.setBrightness(homogenized_brightness);
+#if defined(UFO_DEBUG) && CROSSFADE_TRANSITIONS
+    if (transition_active) {
+        // cost of reanimate() while a cross-fade is running, printed seldom so the printing doesn't skew it
+        EVERY_N_SECONDS(1) {
+            DEBUG_PRINT("transition frame us: ");
+            DEBUG_PRINTLN(micros() - frame_start_micros);
+        }
     }
+#endif
 }
 
 
@@ -425,7 +841,7 @@ int8_t ReAnimator::run_pattern(Pattern pattern) {
             retval = INT8_MIN;
             // fall through to next case
         case ORBIT:
-            orbit(20, orbit_delta);
+            orbit(modulated_interval(20), orbit_delta);
             break;
         case THEATER_CHASE:
             //theater_chase(350, dfp);
@@ -437,62 +853,78 @@ int8_t ReAnimator::run_pattern(Pattern pattern) {
             //accelerate_decelerate_pattern(97, 2, 1000, &ReAnimator::running_lights, dfp); // for filming
             break;
         case SHOOTING_STAR:
-            shooting_star(5, 5, 40, 50, dfp);
+            shooting_star(modulated_interval(5), modulated_size(5), modulated_fade(40), 50, dfp);
             break;
         case CYLON:
-            cylon(20, dfp);
+            cylon(modulated_interval(20), dfp);
             break;
         case SOLID:
-            solid(200);
+            solid(modulated_interval(200));
             break;
         case JUGGLE:
             juggle();
             break;
         case MITOSIS:
-            mitosis(50, 1);
+            mitosis(modulated_interval(50), modulated_size(1));
             break;
         case BUBBLES:
-            bubbles(100, dfp);
+            bubbles(modulated_interval(100), dfp);
             break;
         case SPARKLE:
-            sparkle(20, false, 32);
+            sparkle(modulated_interval(20), false, modulated_fade(32), rim_leds);
             break;
         case MATRIX:
-            matrix(50);
+            matrix(modulated_interval(50));
             break;
         case WEAVE:
-            weave(60);
+            weave(modulated_interval(60));
             break;
         case STARSHIP_RACE:
-            starship_race(88, dfp);
+            starship_race(modulated_interval(88), dfp);
             break;
         case PAC_MAN:
-            pac_man(150, dfp);
+            pac_man(modulated_interval(150), dfp);
             break;
         case BALLS:
-            bouncing_balls(40, dfp);
+            bouncing_balls(modulated_interval(40), dfp);
             break;
         case HALLOWEEN_FADE:
-            halloween_colors_fade(50);
+            halloween_colors_fade(modulated_interval(50));
             break;
         case HALLOWEEN_ORBIT:
-            halloween_colors_orbit(20, orbit_delta);
+            halloween_colors_orbit(modulated_interval(20), orbit_delta);
             break;
         case SOUND_RIBBONS:
-            sound_ribbons(30);
+            sound_ribbons(modulated_interval(30));
             break;
         case SOUND_RIPPLE:
-            sound_ripple(100, (sample_peak==1));
+            sound_ripple(modulated_interval(100), (sample_peak==1));
             break;
         case SOUND_BLOCKS:
-            sound_blocks(50, (sound_value > 32));
+            sound_blocks(modulated_interval(50), (sound_value > 32));
             break;
         case SOUND_ORBIT:
-            sound_orbit(30, dfp);
+            sound_orbit(modulated_interval(30), dfp);
             break;
         case DYNAMIC_RAINBOW:
             //accelerate_decelerate_pattern(30, 2, 1000, &ReAnimator::dynamic_rainbow, dfp);
-            dynamic_rainbow(50, dfp);
+            dynamic_rainbow(modulated_interval(50), dfp);
+            break;
+#if PATTERN_SCRIPTS
+        case SCRIPT:
+            script(dfp);
+            break;
+#endif
+        case VERTICAL_SWEEP:
+            // top to bottom, helm then rim then beam
+            sweep(modulated_interval(20), GEOMETRY_HEIGHT, !reverse ? -2 : 2, 2);
+            break;
+        case ROTATIONAL_SWEEP:
+            sweep(modulated_interval(20), GEOMETRY_ANGLE, !reverse ? 3 : -3, 1);
+            break;
+        case RADIAL_SWEEP:
+            // out from the axis
+            sweep(modulated_interval(20), GEOMETRY_RADIUS, !reverse ? 2 : -2, 2);
             break;
     }
 
@@ -516,7 +948,11 @@ void ReAnimator::apply_overlay(Overlay overlay) {
             breathing(10);
             break;
         case CONFETTI:
-            sparkle(20, true, 0);
+#if RENDER_LAYERS
+            sparkle(20, true, 20, rim_overlay_leds);
+#else
+            sparkle(20, true, 0, rim_leds); // the pattern fades the confetti along with its own pixels
+#endif
             break;
         case FLICKER:
             flicker(150);
@@ -524,7 +960,7 @@ void ReAnimator::apply_overlay(Overlay overlay) {
         case FROZEN_DECAY:
             freezer.timer(7000);
             if (freezer.is_frozen()) {
-                fade_randomly(7, 100);
+                freezer.set_lit_pixels(fade_randomly(7, 100));
             }
             break;
     }
@@ -538,42 +974,47 @@ void ReAnimator::apply_overlay(Overlay overlay) {
 // ++++++++++++++++++++++++++++++
 
 void ReAnimator::orbit(uint16_t draw_interval, int8_t delta) {
-    static uint16_t pos = NUM_RIM_LEDS;
-    static uint8_t loop_num = 0;
+    uint16_t &pos = pattern_state.orbit.pos;
+    uint8_t &loop_num = pattern_state.orbit.loop_num;
 
     if (pattern != last_pattern_ran) {
-        pos = NUM_RIM_LEDS;
+        pos = num_leds;
+        loop_num = 0;
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 20);
+        fade_leds(rim_leds, num_leds, 20);
 
         if (delta > 0) {
-            pos = pos % NUM_RIM_LEDS;
+            pos = pos % num_leds;
         }
         else {
             // pos underflows after it goes below zero
-            if (pos > NUM_RIM_LEDS-1) {
-                pos = NUM_RIM_LEDS-1;
+            if (pos > num_leds-1) {
+                pos = num_leds-1;
             }
         }
 
-        rim_leds[pos] = CHSV(*selected_rim_hue, 255, 255);
+        rim_leds[pos] = rim_color(255);
         pos = pos + delta;
 
-        loop_num = (pos == NUM_RIM_LEDS) ? loop_num+1 : loop_num; 
+        loop_num = (pos == num_leds) ? loop_num+1 : loop_num; 
     }
 }
 
 
 void ReAnimator::theater_chase(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    static uint16_t delta = 0;
+    uint16_t &delta = pattern_state.theater_chase.delta;
+
+    if (pattern != last_pattern_ran) {
+        delta = 0;
+    }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 230);
+        fade_leds(rim_leds, num_leds, 230);
 
-        for (uint16_t i = 0; i+delta < NUM_RIM_LEDS; i=i+3) {
-            rim_leds[(this->*dfp)(i+delta)] = CHSV(*selected_rim_hue, 255, 255);
+        for (uint16_t i = 0; i+delta < num_leds; i=i+3) {
+            rim_leds[(this->*dfp)(i+delta)] = rim_color(255);
         }
 
         delta = (delta + 1) % 3;
@@ -583,17 +1024,21 @@ void ReAnimator::theater_chase(uint16_t draw_interval, uint16_t(ReAnimator::*dfp
 
 void ReAnimator::running_lights(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
     const uint8_t num_waves = 3; // results in three full sine waves across LED strip
-    static uint16_t delta = 0;
+    uint16_t &delta = pattern_state.running_lights.delta;
+
+    if (pattern != last_pattern_ran) {
+        delta = 0;
+    }
 
     if (is_wait_over(draw_interval)) {
-        for (uint16_t i = 0; i < NUM_RIM_LEDS; i++) {
-            uint16_t a = num_waves*(i+delta)*255/(NUM_RIM_LEDS-1);
+        for (uint16_t i = 0; i < num_leds; i++) {
+            uint16_t a = num_waves*(i+delta)*255/(num_leds-1);
             // this pattern normally runs from right-to-left, so flip it by using negative indexing
-            uint16_t ni = (NUM_RIM_LEDS-1) - i;
-            rim_leds[(this->*dfp)(ni)] = CHSV(*selected_rim_hue, 255, sin8(a));
+            uint16_t ni = (num_leds-1) - i;
+            rim_leds[(this->*dfp)(ni)] = rim_color(sin8(a));
         }
 
-        delta = (delta + 1) % (NUM_RIM_LEDS/num_waves);
+        delta = (delta + 1) % (num_leds/num_waves);
     }
 }
 
@@ -602,46 +1047,57 @@ void ReAnimator::running_lights(uint16_t draw_interval, uint16_t(ReAnimator::*df
 //star_trail_decay - how fast the star trail decays. A larger number makes the tail short and/or disappear faster.
 //spm - stars per minute
 void ReAnimator::shooting_star(uint16_t draw_interval, uint8_t star_size, uint8_t star_trail_decay, uint8_t spm, uint16_t(ReAnimator::*dfp)(uint16_t)) {  
-    static uint16_t start_pos = random16(0, NUM_RIM_LEDS/4);
-    static uint16_t stop_pos = random16(star_size+(NUM_RIM_LEDS/2), NUM_RIM_LEDS);
+    ObjectPool<Star, MAX_STARS> &stars = pattern_state.shooting_star.stars;
+    Coroutine &co = pattern_state.shooting_star.co;
 
-    const uint16_t cool_down_interval = (60000-(spm*NUM_RIM_LEDS*draw_interval))/spm; // adds a delay between creation of new shooting stars
-    static uint32_t cdi_pm = 0; // cool_down_interval_previous_millis
+    // stars are launched at random times averaging spm a minute, so now and then a few are in flight at once
+    const uint16_t max_launch_interval = min(2UL*(60000/spm), 32767UL);
 
-    static uint16_t pos = start_pos;
+    // on a short span the star still has to fit between stop_pos and the end
+    const uint16_t stop_pos_min = min(star_size+(num_leds/2), num_leds-1);
 
     if (pattern != last_pattern_ran) {
-        start_pos = random16(0, NUM_RIM_LEDS/4);
-        stop_pos = random16(star_size+(NUM_RIM_LEDS/2), NUM_RIM_LEDS);
-        pos = start_pos;
-        //cdi_pm doesn't need to be reset here because it's a cool down timer
+        stars.clear();
+        CO_RESET(co);
     }
 
     if (is_wait_over(draw_interval)) {
         fade_randomly(128, star_trail_decay);
 
-        if ( (millis() - cdi_pm) > cool_down_interval ) {
+        for (uint8_t s = 0; s < stars.size();) {
+            Star &star = stars[s];
+            if (star.pos+(star_size-1) > star.stop_pos) {
+                stars.retire(s);
+                continue;
+            }
             for (uint8_t i = 0; i < star_size; i++) {
-                rim_leds[(this->*dfp)(pos+(star_size-1)-i)] += CHSV(*selected_rim_hue, 255, 255);
+                rim_leds[(this->*dfp)(star.pos+(star_size-1)-i)] += rim_color(255);
                 // we have to subtract 1 from star_size because one piece goes at pos
                 // example, if star_size = 3: [*]  [*]  [*]
                 //                            pos pos+1 pos+2
             }
-            pos++;
-            if (pos+(star_size-1) >= stop_pos+1) {
-                start_pos = random16(0, NUM_RIM_LEDS/4);
-                stop_pos = random16(star_size+(NUM_RIM_LEDS/2), NUM_RIM_LEDS);
-                pos = start_pos;
-                cdi_pm = millis();
+            star.pos++;
+            s++;
+        }
+
+        CO_BEGIN(co, now());
+        for (;;) {
+            // skipped if MAX_STARS are already in flight
+            if (stars.size() < MAX_STARS) {
+                Star *star = stars.spawn();
+                star->stop_pos = random16(stop_pos_min, num_leds);
+                star->pos = random16(0, num_leds/4);
             }
+            CO_YIELD_FOR(co, random16(max_launch_interval));
         }
+        CO_END(co);
     }
 }
 
 
 void ReAnimator::cylon(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    static uint16_t pos = 0;
-    static int8_t delta = 1;
+    uint16_t &pos = pattern_state.cylon.pos;
+    int8_t &delta = pattern_state.cylon.delta;
 
     if (pattern != last_pattern_ran) {
         pos = 0;
@@ -649,12 +1105,12 @@ void ReAnimator::cylon(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 20);
+        fade_leds(rim_leds, num_leds, 20);
 
-        rim_leds[(this->*dfp)(pos)] += CHSV(*selected_rim_hue, 255, 192);
+        rim_leds[(this->*dfp)(pos)] += rim_color(192);
 
         pos = pos + delta;
-        if (pos == 0 || pos == NUM_RIM_LEDS-1) {
+        if (pos == 0 || pos == num_leds-1) {
             delta = -delta;
         }
     }
@@ -663,7 +1119,7 @@ void ReAnimator::cylon(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16
 
 void ReAnimator::solid(uint16_t draw_interval) {
     if (is_wait_over(draw_interval)) {
-        fill_solid(rim_leds, NUM_RIM_LEDS, CHSV(*selected_rim_hue, 255, 255));
+        fill_solid(rim_leds, num_leds, rim_color(255));
     }
 }
 
@@ -671,34 +1127,34 @@ void ReAnimator::solid(uint16_t draw_interval) {
 // borrowed from FastLED/examples/DemoReel00.ino -Mark Kriegsman, December 2014
 void ReAnimator::juggle() {
     // eight colored dots, weaving in and out of sync with each other
-    fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 20);
+    fade_leds(rim_leds, num_leds, 20);
     byte dothue = 0;
     for(uint8_t i = 0; i < 8; i++) {
-        rim_leds[beatsin16( i+7, 0, NUM_RIM_LEDS-1 )] |= CHSV(dothue, 200, 255);
+        rim_leds[beatsin16( i+7, 0, num_leds-1 )] |= CHSV(dothue, 200, 255);
         dothue += 32;
     }
 }
 
 
 void ReAnimator::mitosis(uint16_t draw_interval, uint8_t cell_size) {
-    const uint16_t start_pos = NUM_RIM_LEDS/2;
-    static uint16_t pos = start_pos;
+    const uint16_t start_pos = num_leds/2;
+    uint16_t &pos = pattern_state.mitosis.pos;
 
     if (pattern != last_pattern_ran) {
         pos = start_pos;
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 30);
+        fade_leds(rim_leds, num_leds, 30);
 
         for (uint8_t i = 0; i < cell_size; i++) {
             uint16_t pi = pos+(cell_size-1)-i;
-            uint16_t ni = (NUM_RIM_LEDS-1) - pi;
-            rim_leds[pi] = CHSV(*selected_rim_hue, 255, 255);
-            rim_leds[ni] = CHSV(*selected_rim_hue, 255, 255);
+            uint16_t ni = (num_leds-1) - pi;
+            rim_leds[pi] = rim_color(255);
+            rim_leds[ni] = rim_color(255);
         }
         pos++;
-        if (pos+(cell_size-1) >= NUM_RIM_LEDS) {
+        if (pos+(cell_size-1) >= num_leds) {
             pos = start_pos;
         }
     }
@@ -706,19 +1162,19 @@ void ReAnimator::mitosis(uint16_t draw_interval, uint8_t cell_size) {
 
 
 void ReAnimator::bubbles(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    const uint8_t num_bubbles = 8;
-    static uint8_t bubble_time[num_bubbles] = {};
+    const uint8_t num_bubbles = NUM_BUBBLES;
+    uint8_t *bubble_time = pattern_state.bubbles.bubble_time;
 
     if (pattern != last_pattern_ran) {
-        bubble_time[num_bubbles] = memset(bubble_time, 0, sizeof(bubble_time));
+        memset(pattern_state.bubbles.bubble_time, 0, sizeof(pattern_state.bubbles.bubble_time));
     }
 
     if (is_wait_over(draw_interval)) {
-        fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
+        fill_solid(rim_leds, num_leds, CRGB::Black);
 
         for (uint8_t i = 0; i < num_bubbles; i++) {
             if (bubble_time[i] == 0 && random8(33) == 0) {
-                bubble_time[i] = random8(1, sqrt16(UINT16_MAX/NUM_RIM_LEDS));
+                bubble_time[i] = random8(1, sqrt16(UINT16_MAX/num_leds));
             }
 
             if (bubble_time[i] > 0) {
@@ -730,9 +1186,9 @@ void ReAnimator::bubbles(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint
                     d = UINT16_MAX;
                 }
 
-                uint16_t pos = lerp16by16(0, NUM_RIM_LEDS-1, d);
-                rim_leds[(this->*dfp)(pos)] += CHSV(i*(256/num_bubbles) + *selected_rim_hue, 255, 192);
-                motion_blur((3*pos)/NUM_RIM_LEDS, pos, dfp);
+                uint16_t pos = lerp16by16(0, num_leds-1, d);
+                rim_leds[(this->*dfp)(pos)] += hue_color(i*(256/num_bubbles) + rim_hue(), 192);
+                motion_blur((3*pos)/num_leds, pos, dfp);
 
                 if (t < UINT8_MAX) {
                     t+=10;
@@ -752,15 +1208,16 @@ void ReAnimator::bubbles(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint
 }
 
 
-void ReAnimator::sparkle(uint16_t draw_interval, bool random_color, uint8_t fade) {
-    uint8_t hue = (random_color) ? random8() : *selected_rim_hue;
+// leds is the pattern layer when sparkle is used as a pattern and the overlay layer when it is used as an overlay
+void ReAnimator::sparkle(uint16_t draw_interval, bool random_color, uint8_t fade, CRGB *leds) {
+    uint8_t hue = (random_color) ? random8() : rim_hue();
 
     // it's necessary to use finished_waiting() here instead of is_wait_over()
     // because sparkle can be an overlay
     if (finished_waiting(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, fade);
+        fade_leds(leds, num_leds, fade);
 
-        rim_leds[random16(NUM_RIM_LEDS)] = CHSV(hue, 255, 255);
+        leds[random16(num_leds)] = hue_color(hue, 255);
     }
 }
 
@@ -768,7 +1225,7 @@ void ReAnimator::sparkle(uint16_t draw_interval, bool random_color, uint8_t fade
 // resembles the green code from The Matrix
 void ReAnimator::matrix(uint16_t draw_interval) {
     if (is_wait_over(draw_interval)) {
-        memmove(&rim_leds[1], &rim_leds[0], (NUM_RIM_LEDS-1)*sizeof(CRGB));
+        memmove(&rim_leds[1], &rim_leds[0], (num_leds-1)*sizeof(CRGB));
 
         if (random8() > 205) {
             rim_leds[0] = CHSV(HUE_GREEN, 255, 255);
@@ -781,134 +1238,130 @@ void ReAnimator::matrix(uint16_t draw_interval) {
 
 
 void ReAnimator::weave(uint16_t draw_interval) {
-    static uint16_t pos = 0;
+    uint16_t &pos = pattern_state.weave.pos;
 
     if (pattern != last_pattern_ran) {
         pos = 0;
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 20);
+        fade_leds(rim_leds, num_leds, 20);
 
-        rim_leds[pos] += CHSV(*selected_rim_hue, 255, 128);
-        rim_leds[NUM_RIM_LEDS-1-pos] += CHSV(*selected_rim_hue+(HUE_PURPLE-HUE_ALIEN_GREEN), 255, 128);
+        rim_leds[pos] += rim_color(128);
+        rim_leds[num_leds-1-pos] += hue_color(rim_hue()+(HUE_PURPLE-HUE_ALIEN_GREEN), 128);
 
-        pos = (pos + 2) % NUM_RIM_LEDS;
+        pos = (pos + 2) % num_leds;
     }
 }
 
 
 void ReAnimator::starship_race(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
     const uint16_t race_distance = (11*UINT8_MAX)/2; // 7/2 -> 3.5 laps
-    const uint8_t total_starships = 5;
-    // UINT8_MAX/NUM_RIM_LEDS is the speed required for a starship to move one LED per redraw
-    const uint8_t range = ceil(static_cast<float>(UINT8_MAX)/NUM_RIM_LEDS);
+    const uint8_t total_starships = TOTAL_STARSHIPS;
+    // UINT8_MAX/num_leds is the speed required for a starship to move one LED per redraw
+    const uint8_t range = ceil(static_cast<float>(UINT8_MAX)/num_leds);
     const uint8_t speed_boost_period = 4; // every N redraws speed_boost is increased
+    const uint8_t victory_redraws = 10; // the winner's color is shown this many redraws before the next race
 
-    static Starship starships[total_starships];
-    static bool go = true;
-    static uint8_t redraw_count = 0;
-    static uint8_t speed_boost = 0;
-    static uint8_t count_down = 0;
+    Starship *starships = pattern_state.starship_race.starships;
+    uint8_t &redraw_count = pattern_state.starship_race.redraw_count;
+    uint8_t &speed_boost = pattern_state.starship_race.speed_boost;
+    Coroutine &co = pattern_state.starship_race.co;
 
     if (pattern != last_pattern_ran) {
-        for (uint8_t i = 0; i < total_starships; i++) {
-            starships[i].distance = 0;
-            starships[i].color = i*(256/total_starships);
-        }
-        go = true;
-        redraw_count = 0;
-        speed_boost = 0;
-        count_down = 0;
+        CO_RESET(co);
     }
 
     if (is_wait_over(draw_interval)) {
-        if (go) {
-            fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
-
+        CO_BEGIN(co, now());
+        for (;;) {
             for (uint8_t i = 0; i < total_starships; i++) {
-                // current_total_distance = previous_total_distance + speed*delta_time, delta_time is always 1
-                starships[i].distance = starships[i].distance + random8(speed_boost, (range+speed_boost)+1);
+                starships[i].distance = 0;
+                starships[i].color = i*(256/total_starships);
             }
+            redraw_count = 0;
+            speed_boost = 0;
 
-            // sort starships by distance travelled in descending order
-            qsort(starships, total_starships, sizeof(Starship), compare);
-
-            for (uint8_t i = 0; i < total_starships; i++) {
-                uint16_t pos = lerp16by8(0, NUM_RIM_LEDS-1, starships[i].distance);
+            while (starships[0].distance < race_distance) {
+                fill_solid(rim_leds, num_leds, CRGB::Black);
 
-                // we don't want multiple starships' position to be on the same LED
-                // if an LED is already lit then a starship is already there so
-                // move backwards until we find an unlit LED
-                while (rim_leds[(this->*dfp)(pos)] != CRGB(CRGB::Black) && pos > 0) {
-                    pos--;
+                for (uint8_t i = 0; i < total_starships; i++) {
+                    // current_total_distance = previous_total_distance + speed*delta_time, delta_time is always 1
+                    starships[i].distance = starships[i].distance + random8(speed_boost, (range+speed_boost)+1);
                 }
-                rim_leds[(this->*dfp)(pos)] = CHSV(starships[i].color, 255, 255);
-            }
 
-            redraw_count++;
-            if (redraw_count == speed_boost_period) {
-                redraw_count = 0;
-                speed_boost++;
-            }
-        }
-        else {
-            // next race will happen after count_down*draw_interval has elapsed
-            count_down--;
-            if (count_down == 0) {
-                go = true;
-            }
-        }
+                // sort starships by distance travelled in descending order
+                qsort(starships, total_starships, sizeof(Starship), compare);
 
-        if (starships[0].distance >= race_distance) {
-            // race is finished
-            fill_solid(rim_leds, NUM_RIM_LEDS, CHSV(starships[0].color, 255, 255));
+                for (uint8_t i = 0; i < total_starships; i++) {
+                    uint16_t pos = lerp16by8(0, num_leds-1, starships[i].distance);
 
-            for (uint8_t i = 0; i < total_starships; i++) {
-                starships[i].distance = 0;
-                starships[i].color = i*(256/total_starships);
+                    // we don't want multiple starships' position to be on the same LED
+                    // if an LED is already lit then a starship is already there so
+                    // move backwards until we find an unlit LED
+                    while (rim_leds[(this->*dfp)(pos)] != CRGB(CRGB::Black) && pos > 0) {
+                        pos--;
+                    }
+                    rim_leds[(this->*dfp)(pos)] = CHSV(starships[i].color, 255, 255);
+                }
+
+                redraw_count++;
+                if (redraw_count == speed_boost_period) {
+                    redraw_count = 0;
+                    speed_boost++;
+                }
+
+                CO_YIELD(co);
             }
 
-            go = false;
-            redraw_count = 0;
-            speed_boost = 0;
-            count_down = 10;
+            // race is finished
+            fill_solid(rim_leds, num_leds, CHSV(starships[0].color, 255, 255));
+            CO_YIELD_FOR(co, victory_redraws*draw_interval);
         }
-
+        CO_END(co);
     }
 }
 
 
 void ReAnimator::pac_man(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    static uint16_t pac_man_pos = 0;
-    static int8_t pac_man_delta = 1;
-
-    static uint16_t blinky_pos = (-2 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-    static uint16_t pinky_pos  = (-3 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-    static uint16_t inky_pos   = (-4 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-    static uint16_t clyde_pos  = (-5 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-    static uint8_t blinky_visible = 1;
-    static uint8_t pinky_visible = 1;
-    static uint8_t inky_visible = 1;
-    static uint8_t clyde_visible = 1;
-    static int8_t ghost_delta = 1;
-
-    static uint16_t power_pellet_pos = 0;
-    static bool power_pellet_flash_state = 1;
-    static uint8_t pac_dots[NUM_RIM_LEDS] = {};
+    uint16_t &pac_man_pos = pattern_state.pac_man.pac_man_pos;
+    int8_t &pac_man_delta = pattern_state.pac_man.pac_man_delta;
+
+    uint16_t &blinky_pos = pattern_state.pac_man.blinky_pos;
+    uint16_t &pinky_pos  = pattern_state.pac_man.pinky_pos;
+    uint16_t &inky_pos   = pattern_state.pac_man.inky_pos;
+    uint16_t &clyde_pos  = pattern_state.pac_man.clyde_pos;
+    uint8_t &blinky_visible = pattern_state.pac_man.blinky_visible;
+    uint8_t &pinky_visible = pattern_state.pac_man.pinky_visible;
+    uint8_t &inky_visible = pattern_state.pac_man.inky_visible;
+    uint8_t &clyde_visible = pattern_state.pac_man.clyde_visible;
+    int8_t &ghost_delta = pattern_state.pac_man.ghost_delta;
+
+    uint16_t &power_pellet_pos = pattern_state.pac_man.power_pellet_pos;
+    bool &power_pellet_flash_state = pattern_state.pac_man.power_pellet_flash_state;
+    bool &power_pellet_eaten = pattern_state.pac_man.power_pellet_eaten;
+    uint8_t *pac_dots = pattern_state.pac_man.pac_dots;
+
+    // the power pellet has to be at least 18 LEDs in, so there's no pac man on a shorter span, and pac_dots only
+    // has room for the dots of a span as long as the rim
+    if (num_leds < PAC_MAN_MIN_LEDS || num_leds > 16*sizeof(pattern_state.pac_man.pac_dots)) {
+        orbit(draw_interval/8, 1);
+        return;
+    }
 
     if (pattern != last_pattern_ran) {
         pac_man_pos = 0;
+        power_pellet_flash_state = true;
     }
 
     if (is_wait_over(draw_interval)) {
-        fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
+        fill_solid(rim_leds, num_leds, CRGB::Black);
 
         if (pac_man_pos == 0) {
-            blinky_pos = (-2 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-            pinky_pos  = (-3 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-            inky_pos   = (-4 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
-            clyde_pos  = (-5 + NUM_RIM_LEDS) % NUM_RIM_LEDS;
+            blinky_pos = (-2 + num_leds) % num_leds;
+            pinky_pos  = (-3 + num_leds) % num_leds;
+            inky_pos   = (-4 + num_leds) % num_leds;
+            clyde_pos  = (-5 + num_leds) % num_leds;
             blinky_visible = 1;
             pinky_visible = 1;
             inky_visible = 1;
@@ -917,20 +1370,20 @@ void ReAnimator::pac_man(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint
             ghost_delta = 1;
 
             // the power pellet must be at least 16 leds forward of led[0]
-            // from 18 to (3/4)*NUM_RIM_LEDS, multiply makes it even so that it falls on a pac_dot led
-            power_pellet_pos = 2*random16(9, (3*NUM_RIM_LEDS)/8 + 1); 
+            // from 18 to (3/4)*num_leds, multiply makes it even so that it falls on a pac_dot led
+            power_pellet_pos = 2*random16(9, (3*num_leds)/8 + 1); 
 
-            for (uint8_t i = 0; i < NUM_RIM_LEDS; i+=2) {
-                pac_dots[i] = 1;
-            }
-            pac_dots[power_pellet_pos] = 2;
+            memset(pac_dots, 0xFF, sizeof(pattern_state.pac_man.pac_dots));
+            power_pellet_eaten = false;
         }
 
-        for (uint8_t i = 0; i < NUM_RIM_LEDS; i+=2) {
-            rim_leds[(this->*dfp)(i)] = (pac_dots[i] == 1) ? CRGB::White : CRGB::Black;
+        for (uint8_t i = 0; i < num_leds; i+=2) {
+            // the power pellet takes the place of a dot
+            bool dot = bitRead(pac_dots[i/16], (i/2)%8) && !(i == power_pellet_pos);
+            rim_leds[(this->*dfp)(i)] = dot ? CRGB::White : CRGB::Black;
         }
 
-        if (pac_dots[power_pellet_pos] == 2) {
+        if (!power_pellet_eaten) {
             if (power_pellet_flash_state) {
                 power_pellet_flash_state = !power_pellet_flash_state;
                 rim_leds[(this->*dfp)(power_pellet_pos)] = CHSV(HUE_RED, 255, 255);
@@ -941,7 +1394,7 @@ void ReAnimator::pac_man(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint
             }
         }
 
-        if (pac_dots[power_pellet_pos] == 2) {
+        if (!power_pellet_eaten) {
             rim_leds[(this->*dfp)(blinky_pos)] = CHSV(HUE_RED, 255, blinky_visible*255);
             rim_leds[(this->*dfp)(pinky_pos)]  = CHSV(HUE_PINK, 255, pinky_visible*255);
             rim_leds[(this->*dfp)(inky_pos)]   = CHSV(HUE_AQUA, 255, inky_visible*255);
@@ -975,47 +1428,51 @@ void ReAnimator::pac_man(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint
         }
 
         blinky_pos = blinky_pos + ghost_delta;
-        blinky_pos = (NUM_RIM_LEDS+blinky_pos) % NUM_RIM_LEDS;
+        blinky_pos = (num_leds+blinky_pos) % num_leds;
         pinky_pos = pinky_pos + ghost_delta;
-        pinky_pos = (NUM_RIM_LEDS+pinky_pos) % NUM_RIM_LEDS;
+        pinky_pos = (num_leds+pinky_pos) % num_leds;
         inky_pos = inky_pos + ghost_delta;
-        inky_pos = (NUM_RIM_LEDS+inky_pos) % NUM_RIM_LEDS;
+        inky_pos = (num_leds+inky_pos) % num_leds;
         clyde_pos = clyde_pos + ghost_delta;
-        clyde_pos = (NUM_RIM_LEDS+clyde_pos) % NUM_RIM_LEDS;
+        clyde_pos = (num_leds+clyde_pos) % num_leds;
 
         rim_leds[(this->*dfp)(pac_man_pos)] = CHSV(HUE_YELLOW, 255, 255);
-        pac_dots[pac_man_pos] = 0;
+        if (pac_man_pos % 2 == 0) {
+            bitClear(pac_dots[pac_man_pos/16], (pac_man_pos/2)%8);
+        }
+        if (pac_man_pos == power_pellet_pos) {
+            power_pellet_eaten = true;
+        }
 
         pac_man_pos = pac_man_pos + pac_man_delta;
-        pac_man_pos = (NUM_RIM_LEDS+pac_man_pos) % NUM_RIM_LEDS;
+        pac_man_pos = (num_leds+pac_man_pos) % num_leds;
     }
 
 }
 
 
-// a ball will move one LED when its height changes by (2^16)/NUM_RIM_LEDS
+// a ball will move one LED when its height changes by (2^16)/num_leds
 // the fastest movement will be from led[0] to led[1] and t=0 to t=ball_time_delta
 // we want the fastest movement to take one draw interval so the function isn't called unnecessarily fast
-// therefore we want ball_time_delta to result in h increasing by (2^16)/NUM_RIM_LEDS
-// for 52 LEDS (2^16)/NUM_RIM_LEDS = 1260 and if ball_vi = vi_max = 510
+// therefore we want ball_time_delta to result in h increasing by (2^16)/num_leds
+// for 52 LEDS (2^16)/num_leds = 1260 and if ball_vi = vi_max = 510
 // -1*t^2 + 510*t - 1260 = 0
 // minimum ball_time_delta = (-510 + sqrt(510^2 - 4*(-1*-1260))/(2*-1) = 2.48
 // increasing ball_time_delta lets you increase the draw_interval therefore decreasing the frequency of redraws
 void ReAnimator::bouncing_balls(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
     const uint16_t vi_max = 510; // initial velocity, 512 will make h exceed UINT16_MAX
     const uint8_t blur_length = 3;
-    const uint8_t num_balls = 5;
+    const uint8_t num_balls = NUM_BALLS;
     const uint8_t ball_time_delta = 4;
-    static uint16_t ball_time[num_balls] = {};
-    static uint16_t ball_vi[num_balls] = {};
+    uint16_t *ball_time = pattern_state.bouncing_balls.ball_time;
+    uint16_t *ball_vi = pattern_state.bouncing_balls.ball_vi;
 
     if (pattern != last_pattern_ran) {
-        ball_time[num_balls] = memset(ball_time, 0, sizeof(ball_time));
-        ball_vi[num_balls] = memset(ball_vi, 0, sizeof(ball_vi));
+        memset(&pattern_state.bouncing_balls, 0, sizeof(pattern_state.bouncing_balls));
     }
 
     if (is_wait_over(draw_interval)) {
-        fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
+        fill_solid(rim_leds, num_leds, CRGB::Black);
 
         for (uint8_t i = 0; i < num_balls; i++) {
             uint16_t t = ball_time[i];
@@ -1031,7 +1488,7 @@ void ReAnimator::bouncing_balls(uint16_t draw_interval, uint16_t(ReAnimator::*df
                 ball_vi[i] = random16(vi_max/3, vi_max+1); // vi_max+1 for up to and including vi_max
             }
 
-            uint16_t pos = lerp16by16(0, NUM_RIM_LEDS-1, h);
+            uint16_t pos = lerp16by16(0, num_leds-1, h);
             rim_leds[(this->*dfp)(pos)] += CHSV(i*(256/num_balls), 255, 192);
             motion_blur((blur_length*(int32_t)v)/(int32_t)vi_max, pos, dfp);
 
@@ -1041,51 +1498,48 @@ void ReAnimator::bouncing_balls(uint16_t draw_interval, uint16_t(ReAnimator::*df
 }
 
 
+// uses the selected palette if there is one, otherwise the Halloween palette
 void ReAnimator::halloween_colors_fade(uint16_t draw_interval) {
-    CRGBPalette16 halloween_colors;
-    halloween_colors = CRGBPalette16(CHSV(HUE_ORANGE, 255, 255),
-                                   CHSV(HUE_PURPLE, 255, 255),
-                                   CHSV(HUE_RED, 255, 255),
-                                   CHSV(HUE_ALIEN_GREEN, 255, 255));
+    uint8_t &delta = pattern_state.halloween_colors_fade.delta;
 
-    static uint8_t delta = 0;
+    if (pattern != last_pattern_ran) {
+        delta = 0;
+    }
 
     if (is_wait_over(draw_interval)) {
-        //fill_palette(rim_leds, NUM_RIM_LEDS, delta, 6, halloween_colors, 255, LINEARBLEND);
-        for(uint16_t i = 0; i < NUM_RIM_LEDS; i++) {
-            rim_leds[i] = ColorFromPalette(halloween_colors, delta, 255);
-        }
+        fill_solid(rim_leds, num_leds, palette_color(delta, HALLOWEEN_PALETTE));
         delta++;
     }
 }
 
 
+// uses the selected palette if there is one, otherwise the Halloween palette
 void ReAnimator::halloween_colors_orbit(uint16_t draw_interval, int8_t delta) {
-    const uint8_t num_hues = 6;
-    static uint8_t hi = 0;
-    uint8_t hues[num_hues] = {HUE_ORANGE, HUE_PURPLE, HUE_ORANGE, HUE_RED, HUE_ORANGE, HUE_ALIEN_GREEN};
+    const uint8_t index_step = 64; // every lap moves to the next anchor color of the palette
+    uint8_t &index = pattern_state.halloween_colors_orbit.index;
 
-    static uint16_t pos = NUM_RIM_LEDS;
+    uint16_t &pos = pattern_state.halloween_colors_orbit.pos;
 
     if (pattern != last_pattern_ran) {
+        index = 0;
         pos = 0;
     }
 
     if (is_wait_over(draw_interval)) {
         if (delta > 0) {
-            pos = pos % NUM_RIM_LEDS;
+            pos = pos % num_leds;
         }
         else {
             // pos underflows after it goes below zero
-            if (pos > NUM_RIM_LEDS-1) {
-                pos = NUM_RIM_LEDS-1;
+            if (pos > num_leds-1) {
+                pos = num_leds-1;
             }
         }
 
-        rim_leds[pos] = CHSV(hues[hi], 255, 255);
+        rim_leds[pos] = palette_color(index, HALLOWEEN_PALETTE);
         pos = pos + delta;
-        if (pos == NUM_RIM_LEDS) {
-            hi = (hi+1) % num_hues;
+        if (pos == num_leds) {
+            index += index_step;
         }
     }
 }
@@ -1093,10 +1547,10 @@ void ReAnimator::halloween_colors_orbit(uint16_t draw_interval, int8_t delta) {
 
 void ReAnimator::sound_ribbons(uint16_t draw_interval) {
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 20);
+        fade_leds(rim_leds, num_leds, 20);
 
-        rim_leds[NUM_RIM_LEDS/2] = CHSV(*selected_rim_hue, 255, sound_value);
-        rim_leds[(NUM_RIM_LEDS/2)-1] = CHSV(*selected_rim_hue, 255, sound_value);
+        rim_leds[num_leds/2] = rim_color(sound_value);
+        rim_leds[(num_leds/2)-1] = rim_color(sound_value);
         fission();
     }                                                                                
 }
@@ -1104,41 +1558,49 @@ void ReAnimator::sound_ribbons(uint16_t draw_interval) {
 
 // derived from this code https://gist.github.com/suhajdab/9716635
 void ReAnimator::sound_ripple(uint16_t draw_interval, bool trigger) {
-    static bool enabled = true;
-    const uint16_t max_delta = 16;
-    static uint16_t delta = 0;
-    static uint16_t center = NUM_RIM_LEDS/2;
+    ObjectPool<Ripple, MAX_RIPPLES> &ripples = pattern_state.sound_ripple.ripples;
+    const uint8_t max_delta = 16;
 
     if (pattern != last_pattern_ran) {
-        enabled = true;
-        delta = 0;
-        center = NUM_RIM_LEDS/2;
+        ripples.clear();
+        Ripple *ripple = ripples.spawn();
+        ripple->center = num_leds/2;
+        ripple->delta = 0;
     }
 
+    // every beat gets a ripple of its own unless MAX_RIPPLES are already spreading
     if (trigger) {
-        enabled = true;
+        Ripple *ripple = ripples.spawn();
+        if (ripple != NULL) {
+            ripple->center = random16(num_leds);
+            ripple->delta = 0;
+        }
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 170);
+        fade_leds(rim_leds, num_leds, 170);
 
-        if (enabled) {
-            // waves created by primary droplet
-            rim_leds[(NUM_RIM_LEDS+center+delta) % NUM_RIM_LEDS] = CHSV(*selected_rim_hue, 255, pow(0.8, delta)*255);
-            rim_leds[(NUM_RIM_LEDS+center-delta) % NUM_RIM_LEDS] = CHSV(*selected_rim_hue, 255, pow(0.8, delta)*255);
+        for (uint8_t r = 0; r < ripples.size();) {
+            Ripple &ripple = ripples[r];
+            uint16_t center = ripple.center;
+            uint8_t delta = ripple.delta;
+
+            // waves created by primary droplet, |= so where ripples cross the brighter wave shows
+            rim_leds[wrap(center+delta)] |= rim_color(pow(0.8, delta)*255);
+            rim_leds[wrap(center-delta)] |= rim_color(pow(0.8, delta)*255);
 
             if (delta > 3) {
                 // waves created by rebounded droplet
-                rim_leds[(NUM_RIM_LEDS+center+(delta-3)) % NUM_RIM_LEDS] = CHSV(*selected_rim_hue, 255, pow(0.8, delta - 2)*255);
-                rim_leds[(NUM_RIM_LEDS+center-(delta-3)) % NUM_RIM_LEDS] = CHSV(*selected_rim_hue, 255, pow(0.8, delta - 2)*255);
+                rim_leds[wrap(center+(delta-3))] |= rim_color(pow(0.8, delta - 2)*255);
+                rim_leds[wrap(center-(delta-3))] |= rim_color(pow(0.8, delta - 2)*255);
             }
 
-            delta++;
-            if (delta == max_delta) {
-                delta = 0;
-                center = random16(NUM_RIM_LEDS);
-                enabled = false;
+            ripple.delta++;
+            if (ripple.delta == max_delta) {
+                ripples.retire(r);
+                continue;
             }
+            r++;
         }
     }
 }
@@ -1146,11 +1608,11 @@ void ReAnimator::sound_ripple(uint16_t draw_interval, bool trigger) {
 
 void ReAnimator::sound_orbit(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
     if (is_wait_over(draw_interval)) {
-        for(uint16_t i = NUM_RIM_LEDS-1; i > 0; i--) {
+        for(uint16_t i = num_leds-1; i > 0; i--) {
             rim_leds[(this->*dfp)(i)] = rim_leds[(this->*dfp)(i-1)];
         }
 
-        rim_leds[(this->*dfp)(0)] = CHSV(*selected_rim_hue, 255, sound_value);
+        rim_leds[(this->*dfp)(0)] = rim_color(sound_value);
     }
 }
 
@@ -1158,20 +1620,24 @@ void ReAnimator::sound_orbit(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(
 void ReAnimator::sound_blocks(uint16_t draw_interval, bool trigger) {
     uint8_t hue = random8();
 
-    static bool enabled = true;
+    bool &enabled = pattern_state.sound_blocks.enabled;
+
+    if (pattern != last_pattern_ran) {
+        enabled = true;
+    }
 
     if (trigger) {
         enabled = true;
     }
 
     if (is_wait_over(draw_interval)) {
-        fadeToBlackBy(rim_leds, NUM_RIM_LEDS, 5);
+        fade_leds(rim_leds, num_leds, 5);
 
         if (enabled) {
-            uint16_t block_start = random16(NUM_RIM_LEDS);
+            uint16_t block_start = random16(num_leds);
             uint8_t block_size = random8(3,8);
             for (uint8_t i = 0; i < block_size; i++) {
-                uint16_t pos = (NUM_RIM_LEDS+block_start+i) % NUM_RIM_LEDS;
+                uint16_t pos = (num_leds+block_start+i) % num_leds;
                 rim_leds[pos] = CHSV(hue, 255, 255);
             }
             enabled = false;
@@ -1181,29 +1647,72 @@ void ReAnimator::sound_blocks(uint16_t draw_interval, bool trigger) {
 
 
 void ReAnimator::dynamic_rainbow(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    static uint16_t delta = 0;
+    uint16_t &delta = pattern_state.dynamic_rainbow.delta;
+
+    if (pattern != last_pattern_ran) {
+        delta = 0;
+    }
 
     if (is_wait_over(draw_interval)) {
-        for(uint16_t i = NUM_RIM_LEDS-1; i > 0; i--) {
+        for(uint16_t i = num_leds-1; i > 0; i--) {
             rim_leds[(this->*dfp)(i)] = rim_leds[(this->*dfp)(i-1)];
         }
 
-        rim_leds[(this->*dfp)(0)] = CHSV(((NUM_RIM_LEDS-1-delta)*255/NUM_RIM_LEDS), 255, 255);
+        rim_leds[(this->*dfp)(0)] = CHSV(((num_leds-1-delta)*255/num_leds), 255, 255);
 
-        delta = (delta + 1) % NUM_RIM_LEDS;
+        delta = (delta + 1) % num_leds;
     }
 }
 
 
-void ReAnimator::helm(uint16_t draw_interval) {
-    static uint16_t pos = 0;
-    static int8_t delta = 1;
-    static uint8_t cycles = 0;
-    const uint8_t cycles_limit = 5;
+#if PATTERN_SCRIPTS
+void ReAnimator::script(uint16_t(ReAnimator::*dfp)(uint16_t)) {
+    script_vm.run(*this, (pattern != last_pattern_ran), dfp);
+}
+#endif
 
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > draw_interval ) {
-        pm = millis();
+
+// A band of light sweeps through the fixture along one of the geometry tables, e.g. GEOMETRY_HEIGHT, and leaves a
+// trail 256>>trail_shift long behind it. The rim, beam and helm are all drawn from the same table so the band crosses
+// from one strip to the next without a seam. Each LED costs one table lookup.
+void ReAnimator::sweep(uint16_t draw_interval, const uint8_t *coordinates, int8_t delta, uint8_t trail_shift) {
+    uint8_t &phase = pattern_state.sweep.phase;
+    const uint8_t trail = UINT8_MAX >> trail_shift;
+
+    if (pattern != last_pattern_ran) {
+        phase = 0;
+    }
+
+    if (is_wait_over(draw_interval)) {
+        phase += delta;
+
+        for (uint16_t i = 0; i < GEOMETRY_NUM_LEDS; i++) {
+            // how far the band has gone past this LED, the subtraction wraps around like the coordinates do
+            uint8_t distance = (delta > 0) ? phase - pgm_read_byte(&coordinates[i]) : pgm_read_byte(&coordinates[i]) - phase;
+            uint8_t value = (distance <= trail) ? UINT8_MAX - (distance << trail_shift) : 0;
+
+            // which LED of the span this is, the subtraction wraps around for LEDs before it
+            uint16_t k = i - geometry_offset;
+
+            if (k < num_leds) {
+                rim_leds[(output_direction > 0) ? k : num_leds-1-k] = rim_color(value);
+            }
+            else if (i >= NUM_RIM_LEDS && i < NUM_RIM_LEDS+NUM_BEAM_LEDS) {
+                if (beam_leds != NULL) {
+                    beam_leds[i-NUM_RIM_LEDS] = beam_color(value);
+                }
+            }
+            else if (i >= NUM_RIM_LEDS+NUM_BEAM_LEDS && helm_leds != NULL) {
+                helm_leds[i-(NUM_RIM_LEDS+NUM_BEAM_LEDS)] = rim_color(value);
+            }
+        }
+    }
+}
+
+
+void ReAnimator::helm(uint16_t draw_interval) {
+    if ( (millis() - helm_previous_millis) > draw_interval ) {
+        helm_previous_millis = millis();
         //fadeToBlackBy(helm_leds, NUM_HELM_LEDS, 8);
 
         // these will blink randomly
@@ -1216,26 +1725,23 @@ void ReAnimator::helm(uint16_t draw_interval) {
         helm_leds[random8(7)] = CRGB::Black;
 
         // these will stay solid
-        helm_leds[0] = CHSV(*selected_rim_hue, 255, 255);
-        helm_leds[4] = CHSV(*selected_beam_hue, 255, 255);
-
-        //pos = pos + delta;
+        helm_leds[0] = rim_color(255);
+        helm_leds[4] = beam_color(255);
     }
 }
 
 
 void ReAnimator::tractor_beam(uint16_t draw_interval) {
-    static uint16_t pos = 0;
-    static int8_t delta = 1;
-    static uint8_t cycles = 0;
+    uint16_t &pos = tractor_beam_pos;
+    int8_t &delta = tractor_beam_delta;
+    uint8_t &cycles = tractor_beam_cycles;
     const uint8_t cycles_limit = 5;
 
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > draw_interval ) {
-        pm = millis();
-        fadeToBlackBy(beam_leds, NUM_BEAM_LEDS, 8);
+    if ( (millis() - tractor_beam_previous_millis) > draw_interval ) {
+        tractor_beam_previous_millis = millis();
+        fade_leds(beam_leds, NUM_BEAM_LEDS, 8);
 
-        beam_leds[pos] = CHSV(*selected_beam_hue, 255, 255);
+        beam_leds[pos] = beam_color(255);
         pos = pos + delta;
 
         // if delta is positive pos is NUM_BEAM_LEDS
@@ -1263,46 +1769,55 @@ void ReAnimator::tractor_beam(uint16_t draw_interval) {
 
 void ReAnimator::breathing(uint16_t interval) {
     const uint8_t min_brightness = 2;
-    static uint8_t delta = 0; // goes up to 255 then overflows back to 0
+    uint8_t &delta = breathing_delta; // goes up to 255 then overflows back to 0
 
-    if (finished_waiting(interval)) {
-        // since FastLED is managing the maximum power delivered use the following function to find the _actual_ maximum brightness allowed for
-        // these power consumption settings. setting brightness to a value higher that max_brightness will not actually increase the brightness.
-        uint8_t max_brightness = calculate_max_brightness_for_power_vmA(rim_leds, NUM_RIM_LEDS, homogenized_brightness, LED_STRIP_VOLTAGE, selected_led_strip_milliamps);
-        uint8_t b = scale8(triwave8(delta), max_brightness-min_brightness)+min_brightness;
-
-        DEBUG_PRINTLN(b);
-        FastLED.setBrightness(b);
+    // the global brightness stays at homogenized_brightness, which already respects the power limit,
+    // so breathing only has to scale the pattern layer between min_brightness and full
+    pattern_layer_brightness = scale8(triwave8(delta), 255-min_brightness)+min_brightness;
 
+    if (finished_waiting(interval)) {
         delta++;
     }
 }
 
 
 void ReAnimator::flicker(uint16_t interval) {
+    bool &on = flicker_on;
+
     fade_randomly(10, 150);
 
     // an on or off period less than 16 ms probably can't be perceived
     if (finished_waiting(interval)) {
-        //FastLED.setBrightness((random8(1,11) > 4)*255);
-        FastLED.setBrightness((random8(1,11) > 4)*homogenized_brightness);
+        on = (random8(1,11) > 4);
     }
+
+    pattern_layer_brightness = on*255;
 }
 
 
 void ReAnimator::glitter(uint16_t chance_of_glitter) {
+#if RENDER_LAYERS
+    // glitter used to be erased by the pattern's own fading, now that it has its own layer it has to fade itself
+    // on its own timer, finished_waiting()'s belongs to whichever overlay runs alongside it
+    if ((millis() - glitter_previous_millis) > 10) {
+        glitter_previous_millis = millis();
+        fade_leds(rim_overlay_leds, num_leds, 8);
+    }
+
     if (chance_of_glitter > random16()) {
-        rim_leds[random16(NUM_RIM_LEDS)] += CRGB::White;
+        rim_overlay_leds[random16(num_leds)] += CRGB::White;
     }
+#else
+    if (chance_of_glitter > random16()) {
+        rim_leds[random16(num_leds)] += CRGB::White;
+    }
+#endif
 }
 
 
-void ReAnimator::fade_randomly(uint8_t chance_of_fade, uint8_t decay) {
-    for (uint16_t i = 0; i < NUM_RIM_LEDS; i++) {
-        if (chance_of_fade > random8()) {
-            rim_leds[i].fadeToBlackBy(decay);
-        }
-    }
+// returns the number of rim LEDs that are still lit after fading
+uint16_t ReAnimator::fade_randomly(uint8_t chance_of_fade, uint8_t decay) {
+    return fade_leds_randomly(rim_leds, num_leds, chance_of_fade, decay);
 }
 
 
@@ -1310,13 +1825,195 @@ void ReAnimator::fade_randomly(uint8_t chance_of_fade, uint8_t decay) {
 // ++++++++++ HELPERS +++++++++++
 // ++++++++++++++++++++++++++++++
 
+// Blend the pattern layer and the overlay layer into the output in a single pass over the rim.
+// During a transition the outgoing frame is blended into the pattern layer in the same pass.
+// Each layer is scaled by its own brightness first so brightness overlays don't have to change the global brightness.
+// Without a separate pattern layer the patterns already drew into the output, so only a reversed span has anything to
+// do. It is flipped in place and flipped back before the next frame's pattern draws, which costs no RAM.
+void ReAnimator::composite() {
+#if !SEPARATE_PATTERN_LAYER
+    if (output_direction < 0) {
+        flip_output();
+    }
+#else
+#if RENDER_LAYERS
+    const bool overlay_active = (transient_overlay == GLITTER || transient_overlay == CONFETTI || persistent_overlay == GLITTER || persistent_overlay == CONFETTI);
+#endif
+    // a span wired in from the other end is written back to front, so the layers never need to know
+    CRGB *output = (output_direction > 0) ? rim_output_leds : rim_output_leds+(num_leds-1);
+
+    for (uint16_t i = 0; i < num_leds; i++) {
+        CRGB p = rim_leds[i];
+#if CROSSFADE_TRANSITIONS
+        if (transition_active) {
+            p = blend(rim_transition_leds[i], p, transition_progress);
+        }
+#endif
+        if (pattern_layer_brightness != 255) {
+            p.nscale8(pattern_layer_brightness);
+        }
+
+#if RENDER_LAYERS
+        if (overlay_active) {
+            CRGB o = rim_overlay_leds[i];
+            if (overlay_layer_brightness != 255) {
+                o.nscale8(overlay_layer_brightness);
+            }
+
+            switch(overlay_blend_mode) {
+                default:
+                case BLEND_ADD:
+                    p += o;
+                    break;
+                case BLEND_MAX:
+                    p |= o;
+                    break;
+                case BLEND_SCALE:
+                    p.r = scale8(p.r, o.r);
+                    p.g = scale8(p.g, o.g);
+                    p.b = scale8(p.b, o.b);
+                    break;
+            }
+        }
+#endif
+
+        *output = p;
+        output += output_direction;
+    }
+#endif
+}
+
+
+#if !SEPARATE_PATTERN_LAYER
+void ReAnimator::flip_output() {
+    for (uint16_t i = 0, j = num_leds-1; i < j; i++, j--) {
+        CRGB t = rim_output_leds[i];
+        rim_output_leds[i] = rim_output_leds[j];
+        rim_output_leds[j] = t;
+    }
+    output_flipped = !output_flipped;
+}
+#endif
+
+
+// GLITTER and CONFETTI share the overlay layer, so the blend mode follows from which of them are on instead of from
+// whichever ran last. Confetti keeps the brighter of its colors and the pattern's and glitter is added. When both are
+// on the whole layer is added.
+void ReAnimator::select_overlay_blend_mode() {
+    const bool glitter_on = (transient_overlay == GLITTER || persistent_overlay == GLITTER);
+    const bool confetti_on = (transient_overlay == CONFETTI || persistent_overlay == CONFETTI);
+
+    overlay_blend_mode = (confetti_on && !glitter_on) ? BLEND_MAX : BLEND_ADD;
+
+#if RENDER_LAYERS
+    // don't let the previous overlay linger on its layer
+    if (!glitter_on && !confetti_on) {
+        fill_solid(rim_overlay_leds, num_leds, CRGB::Black);
+    }
+#endif
+}
+
+
+// For patterns built around a particular palette. If the user hasn't selected a palette the fallback is loaded instead.
+CRGB ReAnimator::palette_color(uint8_t index, Palette fallback) {
+    gradient.load((palette != NO_PALETTE) ? palette : fallback);
+    return gradient.color(index);
+}
+
+
+void ReAnimator::refresh_hue_cache() {
+    if (hue_cache_stale || rim_hue() != cached_rim_hue) {
+        cached_rim_hue = rim_hue();
+        rim_hue_rgb = hue_color(cached_rim_hue, 255);
+    }
+
+    if (hue_cache_stale || *selected_beam_hue != cached_beam_hue) {
+        cached_beam_hue = *selected_beam_hue;
+        beam_hue_rgb = hue_color(cached_beam_hue, 255);
+    }
+
+    hue_cache_stale = false;
+}
+
+
+// same as hue_color(rim_hue(), value) but without the HSV conversion
+CRGB ReAnimator::rim_color(uint8_t value) {
+    return scale_by_value(rim_hue_rgb, value);
+}
+
+
+// the selected rim hue plus whatever the modulators add to it, patterns should use this instead of *selected_rim_hue
+uint8_t ReAnimator::rim_hue() {
+#if PATTERN_MODULATION
+    return modulation.hue(*selected_rim_hue);
+#else
+    return *selected_rim_hue;
+#endif
+}
+
+
+uint16_t ReAnimator::modulated_interval(uint16_t draw_interval) {
+#if PATTERN_MODULATION
+    return modulation.interval(draw_interval);
+#else
+    return draw_interval;
+#endif
+}
+
+
+uint8_t ReAnimator::modulated_fade(uint8_t fade) {
+#if PATTERN_MODULATION
+    return modulation.fade(fade);
+#else
+    return fade;
+#endif
+}
+
+
+uint8_t ReAnimator::modulated_size(uint8_t size) {
+#if PATTERN_MODULATION
+    return modulation.size(size);
+#else
+    return size;
+#endif
+}
+
+
+// same as hue_color(*selected_beam_hue, value) but without the HSV conversion
+CRGB ReAnimator::beam_color(uint8_t value) {
+    return scale_by_value(beam_hue_rgb, value);
+}
+
+
+// Dims a full brightness color exactly like hsv2rgb_rainbow() applies a CHSV's value, i.e. value is squared with
+// scale8_video() and then every channel is scaled by it with plain scale8(), so a cached color matches what
+// CHSV(hue, 255, value) would have produced down to the last bit and dim values still go all the way to black.
+CRGB ReAnimator::scale_by_value(CRGB c, uint8_t value) {
+    if (value != 255) {
+        uint8_t v = scale8_video(value, value);
+        if (v == 0) {
+            return CRGB::Black;
+        }
+        c.nscale8(v);
+    }
+    return c;
+}
+
+
+// index modulo num_leds for indexes that may have gone below zero or past the end of a short span
+uint16_t ReAnimator::wrap(int16_t index) {
+    int16_t i = index % static_cast<int16_t>(num_leds);
+    return (i < 0) ? i+num_leds : i;
+}
+
+
 uint16_t ReAnimator::forwards(uint16_t index) {
     return index;
 }
 
 
 uint16_t ReAnimator::backwards(uint16_t index) {
-    return (NUM_RIM_LEDS-1)-index;
+    return (num_leds-1)-index;
 }
 
 
@@ -1327,33 +2024,60 @@ uint16_t ReAnimator::backwards(uint16_t index) {
 // is_wait_over() has been added. This is only a concern when a pattern
 // function and an overlay function are both called at the same time.
 // Patterns should use is_wait_over() and overlays should use finished_waiting(). 
+// The previous millis is a member instead of a static so a cross-fade can swap in the outgoing pattern's timer.
+// A follower ignores interval and waits for its leader's next draw instead.
 bool ReAnimator::is_wait_over(uint16_t interval) {
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > interval ) {
-        pm = millis();
+    if (leader != NULL) {
+        if (draw_ticks != leader->draw_ticks) {
+            draw_ticks = leader->draw_ticks;
+            return true;
+        }
+        return false;
+    }
+
+#if SYNC_LINK
+    // The elapsed time is signed because a slewing clock can step back a little, which must not count as a long wait.
+    // Snapping to the start of the slot makes every controller with the same clock draw on the same millisecond.
+    uint32_t t = now();
+    if (static_cast<int32_t>(t - pattern_previous_millis) > static_cast<int32_t>(interval)) {
+        pattern_previous_millis = t - (t % (static_cast<uint32_t>(interval)+1));
+        draw_ticks++;
         return true;
     }
-    else {
-        return false;
+#else
+    if ( (millis() - pattern_previous_millis) > interval ) {
+        pattern_previous_millis = millis();
+        draw_ticks++;
+        return true;
     }
+#endif
+
+    return false;
 }
 
 
 bool ReAnimator::finished_waiting(uint16_t interval) {
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > interval ) {
-        pm = millis();
+#if SYNC_LINK
+    // same slots as is_wait_over() so overlays and accelerate_decelerate_pattern() stay in step across controllers too
+    uint32_t t = now();
+    if (static_cast<int32_t>(t - overlay_previous_millis) > static_cast<int32_t>(interval)) {
+        overlay_previous_millis = t - (t % (static_cast<uint32_t>(interval)+1));
         return true;
     }
-    else {
-        return false;
+#else
+    if ( (millis() - overlay_previous_millis) > interval ) {
+        overlay_previous_millis = millis();
+        return true;
     }
+#endif
+
+    return false;
 }
 
 
 void ReAnimator::accelerate_decelerate_pattern(uint16_t draw_interval_initial, uint16_t delta_initial, uint16_t update_period, void(ReAnimator::*pfp)(uint16_t, uint16_t(ReAnimator::*dfp)(uint16_t)), uint16_t(ReAnimator::*dfp)(uint16_t)) {
-    static uint16_t draw_interval = draw_interval_initial;
-    static int8_t delta = delta_initial;
+    uint16_t &draw_interval = pattern_state.accelerate_decelerate.draw_interval;
+    int8_t &delta = pattern_state.accelerate_decelerate.delta;
 
     if (pattern != last_pattern_ran) {
         draw_interval = draw_interval_initial;
@@ -1369,18 +2093,13 @@ void ReAnimator::accelerate_decelerate_pattern(uint16_t draw_interval_initial, u
         }
     }
 
-    (this->*pfp)(draw_interval, dfp);
+    (this->*pfp)(modulated_interval(draw_interval), dfp);
 }
 
 
 // derived from this code https://github.com/atuline/FastLED-Demos/blob/master/soundmems_demo/soundmems.h
 void ReAnimator::process_sound() {
     const uint16_t DC_OFFSET = 513;  // measured
-    const uint8_t NUM_SAMPLES = 64;
-
-    static int16_t sample_buffer[NUM_SAMPLES];
-    static uint16_t sample_sum = 0;
-    static uint8_t i = 0;
 
     int16_t sample = 0;
 
@@ -1393,10 +2112,10 @@ void ReAnimator::process_sound() {
         sample = 0;
     }
 
-    sample_sum += sample - sample_buffer[i]; // add newest sample and subtract oldest sample from the sum
+    // A recursive average instead of a moving average of the last NUM_SAMPLES samples, which needed a 128 byte buffer.
+    // Each new sample replaces 1/NUM_SAMPLES of the sum, so it follows the sound about as quickly.
+    sample_sum += sample - sample_average;
     sample_average = sample_sum / NUM_SAMPLES;
-    sample_buffer[i] = sample;  // overwrite oldest sample with newest sample
-    i = (i + 1) % NUM_SAMPLES;
 
     sound_value = sound_value_gain*sample_average;
     sound_value = min(sound_value, 255);
@@ -1420,7 +2139,7 @@ void ReAnimator::motion_blur(int8_t blur_num, uint16_t pos, uint16_t(ReAnimator:
     }
     else if (blur_num < 0) {
         for (uint8_t i = 1; i < abs(blur_num)+1; i++) {
-            if (pos+i < NUM_RIM_LEDS) {
+            if (pos+i < num_leds) {
                 rim_leds[(this->*dfp)(pos+i)] += rim_leds[(this->*dfp)(pos)];
                 rim_leds[(this->*dfp)(pos+i)].fadeToBlackBy(120+(i*120/abs(blur_num)));
             }
@@ -1430,11 +2149,11 @@ void ReAnimator::motion_blur(int8_t blur_num, uint16_t pos, uint16_t(ReAnimator:
 
 
 void ReAnimator::fission() {
-    for (uint16_t i = NUM_RIM_LEDS-1; i > NUM_RIM_LEDS/2; i--) {
+    for (uint16_t i = num_leds-1; i > num_leds/2; i--) {
         rim_leds[i] = rim_leds[i-1];
     }
 
-    for (uint16_t i = 0; i < NUM_RIM_LEDS/2; i++) {
+    for (uint16_t i = 0; i < num_leds/2; i++) {
         rim_leds[i] = rim_leds[i+1];
     }
 }
@@ -1442,19 +2161,20 @@ void ReAnimator::fission() {
 
 // freeze_interval must be greater than m_failsafe_timeout
 void ReAnimator::Freezer::timer(uint16_t freeze_interval) {
-    static uint32_t pm = millis() - freeze_interval; // previous millis
-
-    if ((millis() - pm) > freeze_interval) {
-        pm = millis();
+    // the first call freezes straight away
+    if (!m_timer_started || (millis() - m_timer_previous_millis) > freeze_interval) {
+        m_timer_started = true;
+        m_timer_previous_millis = millis();
         m_frozen = true;
         m_frozen_previous_millis = millis();
+        m_lit_pixels = parent.num_leds; // unknown until the first fade while frozen reports back
     }
 }
 
 
 bool ReAnimator::Freezer::is_frozen() {
-    static bool all_black = false;
-    static uint16_t frozen_duration = m_failsafe_timeout;
+    bool &all_black = m_all_black;
+    uint16_t &frozen_duration = m_frozen_duration;
 
     if ((millis() - m_frozen_previous_millis) > frozen_duration) {
         m_frozen = false;
@@ -1462,13 +2182,9 @@ bool ReAnimator::Freezer::is_frozen() {
         frozen_duration = m_failsafe_timeout;
     }
     else if (!all_black) {
-        for (uint16_t i = 0; i < NUM_RIM_LEDS; i++) {
-            all_black = true;
-            if (parent.rim_leds[i] != CRGB(CRGB::Black)) {
-                all_black = false;
-                break;
-            }
-        }
+        // the pattern doesn't run while frozen so the only thing changing the rim is the fade from FROZEN_DECAY,
+        // which reports how many LEDs it left lit, so there is no need to scan the whole strip here
+        all_black = (m_lit_pixels == 0);
         if (all_black && ((m_frozen_previous_millis + m_failsafe_timeout) - millis()) > m_after_all_black_pause) {
             // after all the LEDs after found to be dark unfreeze after a short pause
             m_frozen_previous_millis = millis();
@@ -1480,6 +2196,11 @@ bool ReAnimator::Freezer::is_frozen() {
 }
 
 
+void ReAnimator::Freezer::set_lit_pixels(uint16_t lit_pixels) {
+    m_lit_pixels = lit_pixels;
+}
+
+
 static int ReAnimator::compare(const void *a, const void *b) {
   Starship *StarshipA = (Starship *)a;
   Starship *StarshipB = (Starship *)b;
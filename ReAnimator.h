@@ -24,6 +24,13 @@
 #define REANIMATOR_H
 
 #include "UFO_LEDs_controller.h"
+#include "Palettes.h"
+#include "PatternVM.h"
+#include "Geometry.h"
+#include "Coroutine.h"
+#include "BrightnessCache.h"
+#include "Modulation.h"
+#include "ObjectPool.h"
 
 
 // Conventions
@@ -41,17 +48,228 @@
 #define MIC_PIN    A1
 
 #define HOMOGENIZE_BRIGHTNESS true
+// With a BrightnessCache attached, HOMOGENIZE_PER_PATTERN true gives each pattern the highest brightness that keeps
+// that pattern under the power limit, instead of giving every pattern the brightness of the hungriest one.
+#define HOMOGENIZE_PER_PATTERN false
+
+// When RENDER_LAYERS is true patterns draw on a layer of their own and GLITTER and CONFETTI on an overlay layer, and
+// composite() blends the two into the strip, so overlays never burn into the pixels patterns read back. The two layers
+// take 3 bytes per LED each, 312 bytes for the rim, which the Nano can't spare, so by default patterns draw straight
+// into the strip and overlays draw on top of them like they always have.
+#define RENDER_LAYERS false
+
+// When autocycle or flipflop changes the pattern the old pattern is cross-faded into the new one instead of cutting over.
+// The outgoing frame is kept in a scratch buffer and the incoming pattern draws on the pattern layer, so a cross-fade
+// costs two rim sized buffers, 312 bytes, unless RENDER_LAYERS already brought the pattern layer. If
+// CROSSFADE_RENDER_OUTGOING is false (the default, meant for the Nano) the outgoing pattern is frozen at the moment of
+// the switch and only fades out. If it is true the outgoing pattern keeps animating in the scratch buffer during the
+// cross-fade, which costs a second pattern render per frame and the patterns' states can no longer share memory
+// (see PatternState). The Nano's free RAM with the two buffers hasn't been measured, so cross-fades are left out
+// unless asked for.
+#define CROSSFADE_TRANSITIONS false
+#define CROSSFADE_RENDER_OUTGOING false
+
+// A cross-fade needs the pattern's own frame apart from the strip too, so it brings the pattern layer with it.
+#define SEPARATE_PATTERN_LAYER (RENDER_LAYERS || CROSSFADE_TRANSITIONS)
+
+// When SYNC_LINK is true patterns draw on fixed slots of the animation clock (see now()) instead of whenever their
+// interval has elapsed, so controllers whose clocks are kept in agreement by a SyncLink draw on the same millisecond.
+#define SYNC_LINK false
+
+// The SCRIPT pattern runs a script through PatternVM (see PatternVM.h). The sketch already nearly fills the Nano's
+// 32 KB of flash and the interpreter's size on AVR hasn't been measured, so it is left out unless asked for.
+#define PATTERN_SCRIPTS false
+
+// Modulators can vary the running pattern's speed, hue, fade and size (see Modulation.h). Nothing in the sketch sets
+// one yet, so they are left out, saving the flash and the 44 bytes of RAM they take, until a sketch calls
+// set_modulator().
+#define PATTERN_MODULATION false
+
+// How the overlay layer is combined with the pattern layer.
+// BLEND_ADD saturates the sum of the two layers, BLEND_MAX keeps the brighter channel of the two layers, and
+// BLEND_SCALE uses the overlay layer as a mask that scales the pattern layer.
+enum BlendMode {BLEND_ADD = 0, BLEND_MAX = 1, BLEND_SCALE = 2};
+
+// Where a ReAnimator's layers are, see ReAnimatorLayers. A layer that isn't compiled in is NULL.
+struct LayerBuffers {
+    CRGB *pattern;
+    CRGB *overlay;
+    CRGB *transition;
+    uint16_t length;
+};
+
+// The buffers a ReAnimator draws in before anything reaches its strip, sized for that strip so a ReAnimator on the
+// 24 LED beam doesn't carry rim sized layers. Which buffers there are depends on RENDER_LAYERS and
+// CROSSFADE_TRANSITIONS, with neither there are none. The sketch owns them and hands them to the ReAnimator, e.g.
+//   ReAnimatorLayers<NUM_BEAM_LEDS> beam_layers;
+//   ReAnimator beam(Span{beam_leds, NUM_BEAM_LEDS, 1, NUM_RIM_LEDS}, beam_layers, &beam_hue, LED_STRIP_INITIAL_MILLIAMPS);
+template <uint16_t N>
+class ReAnimatorLayers {
+#if SEPARATE_PATTERN_LAYER
+    CRGB m_pattern[N];
+#endif
+#if RENDER_LAYERS
+    CRGB m_overlay[N];
+#endif
+#if CROSSFADE_TRANSITIONS
+    CRGB m_transition[N];
+#endif
+
+  public:
+    LayerBuffers buffers() {
+        LayerBuffers b = {NULL, NULL, NULL, N};
+#if SEPARATE_PATTERN_LAYER
+        b.pattern = m_pattern;
+#endif
+#if RENDER_LAYERS
+        b.overlay = m_overlay;
+#endif
+#if CROSSFADE_TRANSITIONS
+        b.transition = m_transition;
+#endif
+        return b;
+    }
+};
 
 class ReAnimator {
 
+    friend class PatternVM;
+
+    static const uint8_t NUM_BUBBLES = 8;
+    static const uint8_t TOTAL_STARSHIPS = 5;
+    static const uint8_t NUM_BALLS = 5;
+    static const uint8_t NUM_SAMPLES = 64;
+    static const uint8_t PAC_MAN_MIN_LEDS = 24;
+    static const uint8_t MAX_STARS = 3;
+    static const uint8_t MAX_RIPPLES = 4;
+
+    struct Starship {
+        uint16_t distance;
+        uint8_t  color;
+    };
+
+    struct Star {
+        uint16_t pos;
+        uint16_t stop_pos;
+    };
+
+    struct Ripple {
+        uint16_t center;
+        uint8_t delta;
+    };
+
+    // Everything a pattern remembers from one frame to the next. This used to live in statics inside each pattern
+    // function, which meant every ReAnimator shared one copy and a second fixture would scramble the first one's patterns.
+    // Each pattern only touches its own member struct and resets it when (pattern != last_pattern_ran).
+    // Only one pattern runs at a time, so the patterns' structs share the same memory and PatternState is the size of
+    // the biggest one (pac_man) instead of the sum of all of them. That only works because every pattern resets all of
+    // its state when it starts. When the outgoing pattern keeps running during a cross-fade two patterns do run at
+    // once, so then each gets its own memory again.
+    struct PatternState {
+        // THEATER_CHASE and RUNNING_LIGHTS use this on top of their own struct
+        struct AccelerateDecelerate { uint16_t draw_interval; int8_t delta; } accelerate_decelerate;
+#if CROSSFADE_TRANSITIONS && CROSSFADE_RENDER_OUTGOING
+        struct {
+#else
+        union {
+#endif
+            struct { uint16_t pos; uint8_t loop_num; } orbit;
+            struct { uint16_t delta; } theater_chase;
+            struct { uint16_t delta; } running_lights;
+            struct { ObjectPool<Star, MAX_STARS> stars; Coroutine co; } shooting_star;
+            struct { uint16_t pos; int8_t delta; } cylon;
+            struct { uint16_t pos; } mitosis;
+            struct { uint8_t bubble_time[NUM_BUBBLES]; } bubbles;
+            struct { uint16_t pos; } weave;
+            struct {
+                Starship starships[TOTAL_STARSHIPS];
+                uint8_t redraw_count;
+                uint8_t speed_boost;
+                Coroutine co;
+            } starship_race;
+            struct {
+                uint16_t pac_man_pos;
+                int8_t pac_man_delta;
+                uint16_t blinky_pos;
+                uint16_t pinky_pos;
+                uint16_t inky_pos;
+                uint16_t clyde_pos;
+                uint8_t blinky_visible;
+                uint8_t pinky_visible;
+                uint8_t inky_visible;
+                uint8_t clyde_visible;
+                int8_t ghost_delta;
+                uint16_t power_pellet_pos;
+                bool power_pellet_flash_state;
+                bool power_pellet_eaten;
+                uint8_t pac_dots[(NUM_RIM_LEDS/2+7)/8]; // one bit for each even LED, which are the only ones with a dot
+            } pac_man;
+            struct { uint16_t ball_time[NUM_BALLS]; uint16_t ball_vi[NUM_BALLS]; } bouncing_balls;
+            struct { uint8_t delta; } halloween_colors_fade;
+            struct { uint8_t index; uint16_t pos; } halloween_colors_orbit;
+            struct { ObjectPool<Ripple, MAX_RIPPLES> ripples; } sound_ripple;
+            struct { bool enabled; } sound_blocks;
+            struct { uint16_t delta; } dynamic_rainbow;
+            struct { uint8_t phase; } sweep;
+        };
+    };
+
+    // Patterns draw into rim_leds. With a separate pattern layer rim_leds points at rim_pattern_leds and overlays
+    // draw into rim_overlay_leds. Neither layer is ever shown directly. composite() blends them into rim_output_leds,
+    // which is the array FastLED transmits. Without one rim_leds is rim_output_leds and overlays draw into it too.
+    // "Rim" is whatever span the patterns run on. The layers belong to the sketch (see ReAnimatorLayers) and num_leds
+    // is the shorter of the span and the layers.
+    CRGB *rim_output_leds;
+    uint16_t num_leds;
+    int8_t output_direction;
+    uint16_t geometry_offset;
+#if SEPARATE_PATTERN_LAYER
+    CRGB *rim_pattern_leds;
+#else
+    bool output_flipped; // a reversed span is flipped in place for output, see composite()
+#endif
+#if RENDER_LAYERS
+    CRGB *rim_overlay_leds;
+#endif
     CRGB *rim_leds;
+
+#if CROSSFADE_TRANSITIONS
+    CRGB *rim_transition_leds;
+    bool transition_active;
+    uint8_t transition_progress;
+    uint32_t transition_previous_millis;
+#if CROSSFADE_RENDER_OUTGOING
+    Pattern outgoing_pattern;
+    bool outgoing_reverse;
+    Pattern outgoing_last_pattern_ran;
+    uint32_t outgoing_previous_millis;
+    PatternState::AccelerateDecelerate outgoing_accelerate_decelerate;
+#endif
+#endif
     CRGB *beam_leds;
     CRGB *helm_leds;
     uint8_t *selected_rim_hue;
     uint8_t *selected_beam_hue;
+
+    // when palette is not NO_PALETTE the selected hues are used as indexes into the palette's gradient
+    Palette palette;
+    GradientCache gradient;
+
+    // The selected hues only change every 100 ms or so but are drawn on every pixel of every frame, so their full
+    // brightness RGB is cached and patterns dim it with scale_by_value() instead of converting from HSV every time.
+    uint8_t cached_rim_hue;
+    uint8_t cached_beam_hue;
+    CRGB rim_hue_rgb;
+    CRGB beam_hue_rgb;
+    bool hue_cache_stale;
     uint16_t selected_led_strip_milliamps;
 
     uint8_t homogenized_brightness;
+    BrightnessCache *brightness_cache;
+
+    uint8_t pattern_layer_brightness;
+    uint8_t overlay_layer_brightness;
+    BlendMode overlay_blend_mode;
 
     Pattern pattern;
     Overlay transient_overlay;
@@ -63,6 +281,34 @@ class ReAnimator {
     bool reverse;
 
     Pattern last_pattern_ran;
+    uint32_t pattern_previous_millis;
+    PatternState pattern_state;
+
+    // A follower draws on its leader's draw ticks instead of its own timer so phase-locked fixtures step together.
+    ReAnimator *leader;
+    uint8_t draw_ticks;
+
+    // added to millis() to get the animation clock, a SyncLink slave steers it to match its master's clock
+    int32_t clock_offset;
+
+#if PATTERN_SCRIPTS
+    PatternVM script_vm;
+#endif
+
+#if PATTERN_MODULATION
+    Modulation modulation;
+#endif
+
+    uint32_t overlay_previous_millis;
+    uint32_t glitter_previous_millis;
+    uint8_t breathing_delta;
+    bool flicker_on;
+
+    uint32_t helm_previous_millis;
+    uint16_t tractor_beam_pos;
+    int8_t tractor_beam_delta;
+    uint8_t tractor_beam_cycles;
+    uint32_t tractor_beam_previous_millis;
 
     bool autocycle_enabled;
     uint32_t autocycle_previous_millis;
@@ -72,26 +318,30 @@ class ReAnimator {
     uint32_t flipflop_previous_millis;
     uint32_t flipflop_interval;
 
+    uint16_t transition_interval;
+
     class Freezer {
         ReAnimator &parent;
         bool m_frozen;
         const uint16_t m_after_all_black_pause = 500;
         const uint16_t m_failsafe_timeout = 3000;
         uint32_t m_frozen_previous_millis;
+        uint16_t m_lit_pixels;
+        bool m_timer_started;
+        uint32_t m_timer_previous_millis;
+        bool m_all_black;
+        uint16_t m_frozen_duration;
 
       public:
         Freezer(ReAnimator &r);
         void timer(uint16_t freeze_interval);
         bool is_frozen();
+        void set_lit_pixels(uint16_t lit_pixels);
     };
 
     Freezer freezer;
 
-    struct Starship {
-        uint16_t distance;
-        uint8_t  color;
-    };
-
+    uint16_t sample_sum; // NUM_SAMPLES times sample_average
     uint16_t previous_sample;
     bool sample_peak;
     uint16_t sample_average;
@@ -100,13 +350,28 @@ class ReAnimator {
     uint8_t sound_value_gain;
 
   public:
-    ReAnimator(CRGB rim_leds[NUM_RIM_LEDS], CRGB beam_leds[NUM_BEAM_LEDS], CRGB helm_leds[NUM_HELM_LEDS], uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps);
-
+    ReAnimator(CRGB rim_leds[NUM_RIM_LEDS], CRGB beam_leds[NUM_BEAM_LEDS], CRGB helm_leds[NUM_HELM_LEDS], ReAnimatorLayers<NUM_RIM_LEDS> &layers, uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps);
+    // Runs the patterns and overlays on a span, e.g. the beam or the helm, with no beam or helm of its own.
+    // Only the first N LEDs of a span longer than its layers are used.
+    template <uint16_t N>
+    ReAnimator(Span strip, ReAnimatorLayers<N> &layers, uint8_t *hue_type, uint16_t led_strip_milliamps)
+        : ReAnimator(strip, layers.buffers(), NULL, NULL, hue_type, hue_type, led_strip_milliamps) {
+    }
+
+    uint8_t *get_selected_rim_hue();
     void set_selected_rim_hue(uint8_t *rim_hue_type);
     void set_selected_beam_hue(uint8_t *beam_hue_type);
+
+    Palette get_palette();
+    void set_palette(Palette palette);
+    CRGB hue_color(uint8_t hue, uint8_t value);
     void set_selected_led_strip_milliamps(uint16_t led_strip_milliamps);
 
     void homogenize_brightness();
+    void set_brightness_cache(BrightnessCache *cache);
+
+    int8_t set_modulator(uint8_t slot, ModSource source, ModTarget target, int8_t depth, uint16_t period);
+    void clear_modulators();
 
     Pattern get_pattern();
     int8_t set_pattern(Pattern pattern);
@@ -114,6 +379,7 @@ class ReAnimator {
     int8_t set_pattern(Pattern pattern, bool reverse, bool disable_autocycle_flipflop);
     int8_t increment_pattern();
     int8_t increment_pattern(bool disable_autocycle_flipflop);
+    bool get_reverse();
 
     Overlay get_overlay(bool is_persistent);
     int8_t set_overlay(Overlay overlay, bool is_persistent);
@@ -131,11 +397,29 @@ class ReAnimator {
     bool get_flipflop_enabled();
     void set_flipflop_enabled(bool enabled);
 
+    int8_t load_builtin_script(BuiltinScript script);
+    int8_t load_eeprom_script();
+
+    uint16_t get_transition_interval();
+    void set_transition_interval(uint16_t interval);
+
+    void follow(ReAnimator *leader);
+    void follow_pattern(Pattern pattern, bool reverse);
+    static bool has_pattern(Pattern pattern);
+
+    uint32_t now();
+    int32_t get_clock_offset();
+    void set_clock_offset(int32_t offset);
+    uint8_t get_homogenized_brightness();
+
     void reanimate();
 
   private:
+    ReAnimator(Span strip, LayerBuffers layers, CRGB *beam_leds, CRGB *helm_leds, uint8_t *rim_hue_type, uint8_t *beam_hue_type, uint16_t led_strip_milliamps);
+
     int8_t run_pattern(Pattern pattern);
     void apply_overlay(Overlay overlay);
+    void homogenize_pattern_brightness();
 
 // ++++++++++++++++++++++++++++++
 // ++++++++++ PATTERNS ++++++++++
@@ -152,7 +436,7 @@ class ReAnimator {
     void juggle();
     void mitosis(uint16_t draw_interval, uint8_t cell_size);
     void bubbles(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t));
-    void sparkle(uint16_t draw_interval, bool random_color, uint8_t fade);
+    void sparkle(uint16_t draw_interval, bool random_color, uint8_t fade, CRGB *leds);
     void matrix(uint16_t draw_interval);
     void weave(uint16_t draw_interval);
     void starship_race(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t));
@@ -168,6 +452,8 @@ class ReAnimator {
     void sound_blocks(uint16_t draw_interval, bool trigger);
 
     void dynamic_rainbow(uint16_t draw_interval, uint16_t(ReAnimator::*dfp)(uint16_t));
+    void script(uint16_t(ReAnimator::*dfp)(uint16_t));
+    void sweep(uint16_t draw_interval, const uint8_t *coordinates, int8_t delta, uint8_t trail_shift);
 
     void helm(uint16_t draw_interval);
     void tractor_beam(uint16_t draw_interval);
@@ -178,17 +464,42 @@ class ReAnimator {
     void breathing(uint16_t interval);
     void flicker(uint16_t interval);
     void glitter(uint16_t chance_of_glitter);
-    void fade_randomly(uint8_t chance_of_fade, uint8_t decay);
+    uint16_t fade_randomly(uint8_t chance_of_fade, uint8_t decay);
 
 // ++++++++++++++++++++++++++++++
 // ++++++++++ HELPERS +++++++++++
 // ++++++++++++++++++++++++++++++
+    void composite();
+#if !SEPARATE_PATTERN_LAYER
+    void flip_output();
+#endif
+    void select_overlay_blend_mode();
+
+    CRGB palette_color(uint8_t index, Palette fallback);
+    void refresh_hue_cache();
+    CRGB rim_color(uint8_t value);
+    uint8_t rim_hue();
+    uint16_t modulated_interval(uint16_t draw_interval);
+    uint8_t modulated_fade(uint8_t fade);
+    uint8_t modulated_size(uint8_t size);
+    CRGB beam_color(uint8_t value);
+    static CRGB scale_by_value(CRGB c, uint8_t value);
+
+    uint16_t wrap(int16_t index);
     uint16_t forwards(uint16_t index);
     uint16_t backwards(uint16_t index);
 
+    bool draws_beam_and_helm(Pattern pattern);
+
     void autocycle();
     void flipflop();
 
+    void begin_transition();
+    void update_transition();
+#if CROSSFADE_TRANSITIONS && CROSSFADE_RENDER_OUTGOING
+    void render_outgoing();
+#endif
+
     bool is_wait_over(uint16_t interval);
     bool finished_waiting(uint16_t interval);
 
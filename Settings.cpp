@@ -0,0 +1,172 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include <stddef.h>
+#include <EEPROM.h>
+#include "Settings.h"
+
+
+SettingsStore::SettingsStore() {
+    m_slot = SETTINGS_EEPROM_SLOTS-1; // so the first write goes to slot 0
+    m_sequence = 0;
+    m_dirty = false;
+    m_dirty_previous_millis = 0;
+    memset(&m_saved, 0, sizeof(m_saved));
+    memset(&m_pending, 0, sizeof(m_pending));
+}
+
+
+// Scans every slot for the newest valid record. Returns false if there isn't one (e.g. a new board),
+// in which case settings is left untouched so the caller's defaults are used.
+bool SettingsStore::load(Settings &settings) {
+    bool found = false;
+    SettingsRecord record;
+
+    eeprom_begin();
+
+    for (uint8_t slot = 0; slot < SETTINGS_EEPROM_SLOTS; slot++) {
+        if (read_record(slot, record)) {
+            // sequence numbers wrap around, so compare them as a signed difference
+            if (!found || static_cast<int16_t>(record.sequence - m_sequence) > 0) {
+                found = true;
+                m_slot = slot;
+                m_sequence = record.sequence;
+                m_saved = record.settings;
+            }
+        }
+    }
+
+    if (found) {
+        settings = m_saved;
+    }
+
+    return found;
+}
+
+
+// Doesn't write anything, just notes what should be written once the settings stop changing.
+void SettingsStore::save(const Settings &settings) {
+    if (memcmp(&settings, &m_saved, sizeof(Settings)) == 0) {
+        m_dirty = false;
+        return;
+    }
+
+    if (!m_dirty || memcmp(&settings, &m_pending, sizeof(Settings)) != 0) {
+        m_pending = settings;
+        m_dirty = true;
+        m_dirty_previous_millis = millis();
+    }
+}
+
+
+// call every loop
+void SettingsStore::service() {
+    if (m_dirty && (millis() - m_dirty_previous_millis) > SETTINGS_SAVE_DELAY) {
+        write_record();
+    }
+}
+
+
+// write now instead of waiting, e.g. before the power is switched off
+void SettingsStore::flush() {
+    if (m_dirty) {
+        write_record();
+    }
+}
+
+
+void SettingsStore::write_record() {
+    SettingsRecord record;
+    memset(&record, 0, sizeof(record)); // so any padding bytes covered by the CRC are known
+    record.version = SETTINGS_VERSION;
+    record.sequence = m_sequence + 1;
+    record.settings = m_pending;
+    record.crc = crc8(reinterpret_cast<const uint8_t *>(&record), offsetof(SettingsRecord, crc));
+
+    uint8_t slot = (m_slot + 1) % SETTINGS_EEPROM_SLOTS;
+    uint16_t address = SETTINGS_EEPROM_ADDRESS + slot*sizeof(SettingsRecord);
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+    for (uint8_t i = 0; i < sizeof(SettingsRecord); i++) {
+        eeprom_update(address+i, data[i]); // bytes that haven't changed aren't written
+    }
+    eeprom_commit();
+
+    m_slot = slot;
+    m_sequence = record.sequence;
+    m_saved = m_pending;
+    m_dirty = false;
+}
+
+
+bool SettingsStore::read_record(uint8_t slot, SettingsRecord &record) {
+    uint16_t address = SETTINGS_EEPROM_ADDRESS + slot*sizeof(SettingsRecord);
+    uint8_t *data = reinterpret_cast<uint8_t *>(&record);
+    for (uint8_t i = 0; i < sizeof(SettingsRecord); i++) {
+        data[i] = EEPROM.read(address+i);
+    }
+
+    return (record.version == SETTINGS_VERSION && record.crc == crc8(data, offsetof(SettingsRecord, crc)));
+}
+
+
+void eeprom_begin() {
+#if defined(ESP8266) || defined(ESP32)
+    EEPROM.begin(EEPROM_SIZE);
+#endif
+}
+
+
+void eeprom_update(uint16_t address, uint8_t value) {
+#if defined(ESP8266) || defined(ESP32)
+    if (EEPROM.read(address) != value) {
+        EEPROM.write(address, value);
+    }
+#else
+    EEPROM.update(address, value);
+#endif
+}
+
+
+void eeprom_commit() {
+#if defined(ESP8266) || defined(ESP32)
+    EEPROM.commit();
+#endif
+}
+
+
+uint8_t crc8(const uint8_t *data, uint8_t length) {
+    uint8_t crc = 0;
+    while (length--) {
+        crc = crc8_update(crc, *data++);
+    }
+    return crc;
+}
+
+
+// for checking data one byte at a time as it arrives
+uint8_t crc8_update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+    return crc;
+}
@@ -0,0 +1,97 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// Bump SETTINGS_VERSION whenever the layout of Settings changes so old records are ignored instead of misread.
+#define SETTINGS_VERSION 1
+// Changes are only written once the settings have stopped changing for this long, so pressing a button
+// repeatedly (e.g. stepping through colors or brightness levels) results in one write instead of many.
+#define SETTINGS_SAVE_DELAY 5000
+
+// Everything the user can pick with the remote that should survive a power cycle.
+// Intervals are stored in tenths of a second to keep the record small.
+struct Settings {
+    uint8_t pattern;
+    uint8_t reverse;
+    uint8_t transient_overlay;
+    uint8_t persistent_overlay;
+    uint8_t palette;
+    uint8_t green_button_index;
+    uint8_t blue_button_index;
+    uint8_t static_rim_hue;
+    uint8_t static_beam_hue;
+    uint8_t sound_value_gain;
+    uint16_t led_strip_milliamps;
+    uint16_t autocycle_interval;
+    uint16_t flipflop_interval;
+    uint8_t autocycle_enabled;
+    uint8_t flipflop_enabled;
+};
+
+// Every save goes to the next of SETTINGS_EEPROM_SLOTS slots in a ring so each EEPROM cell is written
+// 1/SETTINGS_EEPROM_SLOTS as often. Each record carries a sequence number and a CRC. On boot the valid record with
+// the newest sequence number wins, so a record that was only partly written when power was lost is simply skipped.
+struct SettingsRecord {
+    uint8_t version;
+    uint16_t sequence;
+    Settings settings;
+    uint8_t crc;
+};
+
+class SettingsStore {
+    uint8_t m_slot;
+    uint16_t m_sequence;
+    bool m_dirty;
+    uint32_t m_dirty_previous_millis;
+    Settings m_saved;
+    Settings m_pending;
+
+  public:
+    SettingsStore();
+    bool load(Settings &settings);
+    void save(const Settings &settings);
+    void service();
+    void flush();
+
+  private:
+    void write_record();
+    bool read_record(uint8_t slot, SettingsRecord &record);
+};
+
+// Every EEPROM access that differs between boards goes through these. On AVR eeprom_update() is EEPROM.update(),
+// which skips bytes that haven't changed, and the other two do nothing. The ESP8266 and ESP32 cores emulate the EEPROM
+// in flash and their EEPROMClass has no update(), so there eeprom_update() reads the byte and only writes it if it
+// differs, eeprom_begin() sets up the emulation and eeprom_commit() writes the changes back to flash.
+void eeprom_begin();
+void eeprom_update(uint16_t address, uint8_t value);
+void eeprom_commit();
+
+// CRC-8 with polynomial 0x07, also used to check packets received over the serial links
+uint8_t crc8(const uint8_t *data, uint8_t length);
+uint8_t crc8_update(uint8_t crc, uint8_t data);
+
+#endif
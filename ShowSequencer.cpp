@@ -0,0 +1,169 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "ShowSequencer.h"
+
+
+// 10 minutes: builds from Halloween colors through the spooky and the alien patterns to a light show finale.
+// At HALLOWEEN_SHOW_BPM a beat is 600 ms.
+const Cue HALLOWEEN_SHOW[] PROGMEM = {
+    // pattern          overlay       hue_source           hue          palette            flags                     length transition
+    {HALLOWEEN_FADE,    NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           HALLOWEEN_PALETTE, 0,                        300,   20},
+    {HALLOWEEN_ORBIT,   NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           HALLOWEEN_PALETTE, 0,                        300,   10},
+    {SHOOTING_STAR,     NO_OVERLAY,   HUE_SOURCE_STATIC,   HUE_ORANGE,  NO_PALETTE,        0,                        250,   10},
+    {CYLON,             NO_OVERLAY,   HUE_SOURCE_STATIC,   HUE_RED,     NO_PALETTE,        CUE_BEATS,                64,    10},
+    {SPARKLE,           NO_OVERLAY,   HUE_SOURCE_DYNAMIC,  0,           FIRE_PALETTE,      0,                        300,   20},
+    {MATRIX,            NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        0,                        300,   20},
+    {BUBBLES,           NO_OVERLAY,   HUE_SOURCE_DYNAMIC,  0,           ALIEN_PALETTE,     0,                        300,   10},
+    {THEATER_CHASE,     GLITTER,      HUE_SOURCE_STATIC,   HUE_PURPLE,  NO_PALETTE,        CUE_BEATS,                32,    0},
+    {RUNNING_LIGHTS,    NO_OVERLAY,   HUE_SOURCE_STATIC,   HUE_GREEN,   NO_PALETTE,        CUE_REVERSE,              300,   10},
+    {SOUND_RIPPLE,      NO_OVERLAY,   HUE_SOURCE_STATIC,   HUE_ALIEN_GREEN, NO_PALETTE,    0,                        300,   10},
+    {WEAVE,             NO_OVERLAY,   HUE_SOURCE_DYNAMIC,  0,           FIRE_PALETTE,      0,                        300,   20},
+    {PAC_MAN,           NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        0,                        400,   10},
+    {JUGGLE,            NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        0,                        200,   10},
+    {ORBIT,             CONFETTI,     HUE_SOURCE_STATIC,   HUE_ORANGE,  NO_PALETTE,        0,                        300,   10},
+    {STARSHIP_RACE,     NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        0,                        400,   10},
+    {BALLS,             NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        CUE_REVERSE,              300,   10},
+    {SOLID,             BREATHING,    HUE_SOURCE_STATIC,   HUE_RED,     NO_PALETTE,        0,                        200,   20},
+    {SOLID,             FLICKER,      HUE_SOURCE_STATIC,   HUE_ALIEN_GREEN, NO_PALETTE,    0,                        150,   0},
+    {DYNAMIC_RAINBOW,   NO_OVERLAY,   HUE_SOURCE_KEEP,     0,           NO_PALETTE,        0,                        300,   20},
+    {HALLOWEEN_ORBIT,   GLITTER,      HUE_SOURCE_KEEP,     0,           HALLOWEEN_PALETTE, 0,                        524,   20},
+};
+const uint8_t HALLOWEEN_SHOW_CUES = sizeof(HALLOWEEN_SHOW)/sizeof(Cue);
+
+
+ShowSequencer::ShowSequencer(ReAnimator &animator, uint8_t *dynamic_hue, uint8_t *random_hue) : m_animator(animator) {
+    m_dynamic_hue = dynamic_hue;
+    m_random_hue = random_hue;
+    m_cue_hue = 0;
+
+    m_user_rim_hue = NULL;
+    m_user_palette = NO_PALETTE;
+    m_user_transition_interval = 0;
+
+    m_cues = NULL;
+    m_num_cues = 0;
+    m_beat_ms = 500;
+
+    m_playing = false;
+    m_cue_index = 0;
+    m_cue_pattern = ORBIT;
+    m_cue_end_millis = 0;
+}
+
+
+void ShowSequencer::load(const Cue *cues, uint8_t num_cues, uint8_t bpm) {
+    stop();
+    m_cues = cues;
+    m_num_cues = num_cues;
+    m_beat_ms = 60000UL/((bpm > 0) ? bpm : 120);
+}
+
+
+void ShowSequencer::play() {
+    if (m_num_cues == 0) {
+        return;
+    }
+
+    if (!m_playing) {
+        m_user_rim_hue = m_animator.get_selected_rim_hue();
+        m_user_palette = m_animator.get_palette();
+        m_user_transition_interval = m_animator.get_transition_interval();
+    }
+
+    m_playing = true;
+    m_cue_end_millis = millis();
+    start_cue(0);
+}
+
+
+void ShowSequencer::stop() {
+    if (m_playing) {
+        m_animator.set_selected_rim_hue(m_user_rim_hue);
+        m_animator.set_palette(m_user_palette);
+        m_animator.set_transition_interval(m_user_transition_interval);
+    }
+    m_playing = false;
+}
+
+
+bool ShowSequencer::is_playing() {
+    return m_playing;
+}
+
+
+void ShowSequencer::service() {
+    if (!m_playing) {
+        return;
+    }
+
+    if (m_animator.get_pattern() != m_cue_pattern) {
+        DEBUG_PRINTLN("show stopped");
+        stop();
+        return;
+    }
+
+    if (static_cast<int32_t>(millis() - m_cue_end_millis) >= 0) {
+        if ((millis() - m_cue_end_millis) > SHOW_MAX_LATE) {
+            m_cue_end_millis = millis();
+        }
+        start_cue((m_cue_index + 1) % m_num_cues);
+    }
+}
+
+
+void ShowSequencer::start_cue(uint8_t index) {
+    Cue cue;
+    memcpy_P(&cue, &m_cues[index], sizeof(Cue));
+
+    m_cue_index = index;
+
+    m_animator.set_transition_interval(100*cue.transition);
+    m_animator.follow_pattern(static_cast<Pattern>(cue.pattern), (cue.flags & CUE_REVERSE));
+    m_animator.set_overlay(static_cast<Overlay>(cue.overlay), false);
+    m_animator.set_palette(static_cast<Palette>(cue.palette));
+
+    switch(cue.hue_source) {
+        default:
+        case HUE_SOURCE_KEEP:
+            break;
+        case HUE_SOURCE_DYNAMIC:
+            m_animator.set_selected_rim_hue(m_dynamic_hue);
+            break;
+        case HUE_SOURCE_STATIC:
+            m_cue_hue = cue.hue;
+            m_animator.set_selected_rim_hue(&m_cue_hue);
+            break;
+        case HUE_SOURCE_RANDOM:
+            m_animator.set_selected_rim_hue(m_random_hue);
+            break;
+    }
+
+    // the pattern it actually ended up running, in case the cue's pattern isn't compiled in
+    m_cue_pattern = m_animator.get_pattern();
+
+    uint32_t length_ms = (cue.flags & CUE_BEATS) ? static_cast<uint32_t>(cue.length)*m_beat_ms : 100UL*cue.length;
+    m_cue_end_millis += length_ms;
+
+    DEBUG_PRINT("cue ");
+    DEBUG_PRINTLN(index);
+}
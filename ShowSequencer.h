@@ -0,0 +1,91 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef SHOW_SEQUENCER_H
+#define SHOW_SEQUENCER_H
+
+#include "UFO_LEDs_controller.h"
+#include "ReAnimator.h"
+
+
+#define CUE_REVERSE 0x01
+#define CUE_BEATS   0x02 // length is in beats of the show's tempo instead of tenths of a second
+
+// One step of a show. Shows are arrays of cues in PROGMEM.
+struct Cue {
+    uint8_t pattern;
+    uint8_t overlay;    // transient overlay, cleared by the next cue
+    uint8_t hue_source; // HueSource
+    uint8_t hue;        // the rim hue when hue_source is HUE_SOURCE_STATIC, the user's static hue is left alone
+    uint8_t palette;
+    uint8_t flags;
+    uint16_t length;    // tenths of a second, or beats with CUE_BEATS
+    uint8_t transition; // cross-fade into this cue in tenths of a second, 0 cuts straight over
+};
+
+// a choreographed 10 minute walkthrough, see ShowSequencer.cpp
+extern const Cue HALLOWEEN_SHOW[] PROGMEM;
+extern const uint8_t HALLOWEEN_SHOW_CUES;
+#define HALLOWEEN_SHOW_BPM 100
+
+// If a cue starts more than this late (e.g. the animations were paused to pick a brightness level) the show
+// continues from now instead of racing through the cues it missed.
+#define SHOW_MAX_LATE 1000
+
+// Plays a show cue after cue and loops back to the start at the end. Only the time the current cue ends is kept,
+// so service() is a single comparison on every frame that doesn't start a new cue. Each cue's end is measured from
+// when the previous cue was due to end rather than when it was noticed, so a long show doesn't drift.
+// The show stops itself if something else (e.g. a button on the remote) changes the pattern.
+// Cues change the rim hue, the palette and the transition interval, so whatever the user had is put back when the
+// show stops. The sketch's remember_settings() keeps the cues' pattern and palette out of the saved settings.
+class ShowSequencer {
+    ReAnimator &m_animator;
+    uint8_t *m_dynamic_hue;
+    uint8_t *m_random_hue;
+    uint8_t m_cue_hue;
+
+    uint8_t *m_user_rim_hue;
+    Palette m_user_palette;
+    uint16_t m_user_transition_interval;
+
+    const Cue *m_cues;
+    uint8_t m_num_cues;
+    uint16_t m_beat_ms;
+
+    bool m_playing;
+    uint8_t m_cue_index;
+    Pattern m_cue_pattern;
+    uint32_t m_cue_end_millis;
+
+  public:
+    ShowSequencer(ReAnimator &animator, uint8_t *dynamic_hue, uint8_t *random_hue);
+    void load(const Cue *cues, uint8_t num_cues, uint8_t bpm);
+    void play();
+    void stop();
+    bool is_playing();
+    void service();
+
+  private:
+    void start_cue(uint8_t index);
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "StackMonitor.h"
+
+#if defined(__AVR__)
+extern uint8_t _end;    // the end of .bss, which is where the heap starts
+extern uint8_t __stack; // RAMEND
+extern char *__brkval;  // the top of the heap, NULL until malloc() is first called
+
+// Runs from .init1, before the stack pointer is set up and before r1 is cleared, so it has to be assembly that
+// touches nothing but the registers it uses.
+void paint_stack() __attribute__((naked, used, section(".init1")));
+void paint_stack() {
+    asm volatile (
+        "ldi r30, lo8(_end)\n\t"
+        "ldi r31, hi8(_end)\n\t"
+        "ldi r24, %[canary]\n\t"
+        "ldi r25, hi8(__stack)\n\t"
+        "rjmp 2f\n\t"
+        "1:\n\t"
+        "st Z+, r24\n\t"
+        "2:\n\t"
+        "cpi r30, lo8(__stack)\n\t"
+        "cpc r31, r25\n\t"
+        "brlo 1b\n\t"
+        :
+        : [canary] "M" (STACK_CANARY)
+    );
+}
+#endif
+
+
+// Bytes of RAM the stack has never reached since reset.
+uint16_t stack_headroom() {
+#if defined(__AVR__)
+    const uint8_t *p = (__brkval == NULL) ? &_end : reinterpret_cast<const uint8_t *>(__brkval);
+    uint16_t headroom = 0;
+    while (p < &__stack && *p == STACK_CANARY) {
+        p++;
+        headroom++;
+    }
+    return headroom;
+#elif defined(ESP32)
+    return uxTaskGetStackHighWaterMark(NULL);
+#else
+    return 0;
+#endif
+}
+
+
+// Bytes between the top of the heap and the stack right now.
+uint16_t free_ram() {
+#if defined(__AVR__)
+    uint8_t top_of_stack;
+    const uint8_t *heap_end = (__brkval == NULL) ? &_end : reinterpret_cast<const uint8_t *>(__brkval);
+    return &top_of_stack - heap_end;
+#elif defined(ESP32)
+    return ESP.getFreeHeap();
+#else
+    return 0;
+#endif
+}
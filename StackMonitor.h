@@ -0,0 +1,46 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef STACK_MONITOR_H
+#define STACK_MONITOR_H
+
+#include "UFO_LEDs_controller.h"
+
+
+// How much RAM is left between the globals (and the heap, if anything uses it) and the deepest the stack has ever
+// gone, so it's known how much headroom there is before e.g. NUM_RIM_LEDS is raised.
+//
+// On AVR the free RAM is painted with STACK_CANARY before main() runs (and before any constructors), and
+// stack_headroom() counts how many painted bytes above the heap the stack has never overwritten. That's the
+// high-water mark for the whole run, not just the moment it's called, so a deep call chain that only happens
+// once is still caught. Counting takes about 1 us per free byte, so only call it every now and then.
+// On ESP32 it's the loop task's high-water mark from FreeRTOS. Elsewhere both return 0.
+//
+// Each extra rim LED takes 3 bytes for rim_leds with the default flags. RENDER_LAYERS adds 6 for the pattern and overlay
+// layers and CROSSFADE_TRANSITIONS adds 6 for the pattern layer and the transition buffer, 9 with both since they share
+// the pattern layer (see ReAnimatorLayers). OUTPUT_PIPELINE adds another 3.
+#define STACK_CANARY 0xC5
+
+uint16_t stack_headroom();
+uint16_t free_ram();
+
+#endif
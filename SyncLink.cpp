@@ -0,0 +1,159 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "SyncLink.h"
+#include "Settings.h"
+
+
+SyncLink::SyncLink(HardwareSerial &serial, ReAnimator &animator, SyncRole role) : m_serial(serial), m_animator(animator) {
+    m_role = role;
+    m_link_delay = 0;
+
+    m_broadcast_previous_millis = 0;
+    m_sent_pattern = ORBIT;
+    m_sent_reverse = false;
+
+    m_received = 0;
+    m_locked = false;
+    m_packet_previous_millis = 0;
+    m_max_error = 0;
+    m_filter_count = 0;
+}
+
+
+void SyncLink::begin(uint32_t baud) {
+    if (m_role != SYNC_OFF) {
+        m_serial.begin(baud);
+    }
+    // time for a whole packet to cross the wire (10 bits per byte), rounded to the nearest ms
+    m_link_delay = (SYNC_PACKET_SIZE*10000UL + baud/2)/baud;
+}
+
+
+void SyncLink::service() {
+    if (m_role == SYNC_MASTER) {
+        bool changed = (m_animator.get_pattern() != m_sent_pattern || m_animator.get_reverse() != m_sent_reverse);
+        if (changed || (millis() - m_broadcast_previous_millis) > SYNC_BROADCAST_INTERVAL) {
+            broadcast();
+        }
+    }
+    else if (m_role == SYNC_SLAVE) {
+        receive();
+        if (m_locked && (millis() - m_packet_previous_millis) > SYNC_LOST_TIMEOUT) {
+            m_locked = false;
+            DEBUG_PRINTLN("sync lost");
+        }
+    }
+}
+
+
+SyncRole SyncLink::get_role() {
+    return m_role;
+}
+
+
+bool SyncLink::is_locked() {
+    return (m_role == SYNC_MASTER) || m_locked;
+}
+
+
+void SyncLink::broadcast() {
+    uint32_t t = m_animator.now();
+
+    m_sent_pattern = m_animator.get_pattern();
+    m_sent_reverse = m_animator.get_reverse();
+
+    m_packet[0] = 0xA5;
+    m_packet[1] = 0x5A;
+    m_packet[2] = t;
+    m_packet[3] = t >> 8;
+    m_packet[4] = t >> 16;
+    m_packet[5] = t >> 24;
+    m_packet[6] = m_sent_pattern;
+    m_packet[7] = m_sent_reverse;
+    m_packet[8] = crc8(m_packet, SYNC_PACKET_SIZE-1);
+
+    // 9 bytes fit in the transmit buffer so this doesn't block
+    m_serial.write(m_packet, SYNC_PACKET_SIZE);
+    m_broadcast_previous_millis = millis();
+}
+
+
+// Bytes are collected until a whole packet has arrived. A bad start byte or CRC throws away what was collected and
+// the search for the next 0xA5 0x5A starts over, so the slave finds its way back into the stream on its own.
+void SyncLink::receive() {
+    while (m_serial.available() > 0) {
+        uint8_t b = m_serial.read();
+
+        if ((m_received == 0 && b != 0xA5) || (m_received == 1 && b != 0x5A)) {
+            m_received = (b == 0xA5) ? 1 : 0;
+            continue;
+        }
+
+        m_packet[m_received++] = b;
+
+        if (m_received == SYNC_PACKET_SIZE) {
+            m_received = 0;
+            if (m_packet[8] == crc8(m_packet, SYNC_PACKET_SIZE-1)) {
+                uint32_t master_time = static_cast<uint32_t>(m_packet[2])
+                                       | (static_cast<uint32_t>(m_packet[3]) << 8)
+                                       | (static_cast<uint32_t>(m_packet[4]) << 16)
+                                       | (static_cast<uint32_t>(m_packet[5]) << 24);
+                discipline(master_time);
+                m_animator.follow_pattern(static_cast<Pattern>(m_packet[6]), m_packet[7] & 0x01);
+            }
+        }
+    }
+}
+
+
+void SyncLink::discipline(uint32_t master_time) {
+    int32_t error = static_cast<int32_t>((master_time + m_link_delay) - m_animator.now());
+
+    m_packet_previous_millis = millis();
+
+    if (!m_locked || error > SYNC_STEP_THRESHOLD || error < -SYNC_STEP_THRESHOLD) {
+        m_animator.set_clock_offset(m_animator.get_clock_offset() + error);
+        m_locked = true;
+        m_filter_count = 0;
+        DEBUG_PRINT("sync step: ");
+        DEBUG_PRINTLN(error);
+        return;
+    }
+
+    if (m_filter_count == 0 || error > m_max_error) {
+        m_max_error = error;
+    }
+
+    m_filter_count++;
+    if (m_filter_count == SYNC_FILTER_PACKETS) {
+        int32_t slew = m_max_error;
+        if (slew > SYNC_MAX_SLEW) {
+            slew = SYNC_MAX_SLEW;
+        }
+        else if (slew < -SYNC_MAX_SLEW) {
+            slew = -SYNC_MAX_SLEW;
+        }
+        m_animator.set_clock_offset(m_animator.get_clock_offset() + slew);
+        m_filter_count = 0;
+    }
+}
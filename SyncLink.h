@@ -0,0 +1,82 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#ifndef SYNC_LINK_H
+#define SYNC_LINK_H
+
+#include "UFO_LEDs_controller.h"
+#include "ReAnimator.h"
+
+
+// Keeps several UFOs in step over a UART. The master broadcasts its animation clock, pattern and direction every
+// SYNC_BROADCAST_INTERVAL and whenever the pattern or direction changes. Each slave steers its animation clock
+// (ReAnimator::now()) toward the master's and runs whatever pattern the master runs. Together with SYNC_LINK in
+// ReAnimator.h, which makes patterns draw on fixed slots of the animation clock, the slaves draw on the same frames as
+// the master. Wire the master's TX to every slave's RX and join the grounds. UFO_DEBUG output shares the UART, the
+// packet CRC lets slaves ignore it, but it's best left off.
+//
+// Packet (SYNC_PACKET_SIZE bytes): 0xA5 0x5A, master clock in ms (4 bytes, little endian), pattern,
+// flags (bit 0 is reverse), CRC-8 of the preceding bytes.
+#define SYNC_PACKET_SIZE 9
+#define SYNC_BROADCAST_INTERVAL 100
+// Errors bigger than this are stepped out at once (e.g. when a slave first hears the master), smaller ones are slewed.
+#define SYNC_STEP_THRESHOLD 50
+// A slave only reads the UART once per loop so a packet can sit in the receive buffer for up to a frame. That delay
+// only ever makes the master's clock look behind, so the largest error seen in SYNC_FILTER_PACKETS packets is the
+// most accurate one. The clock is then slewed by at most SYNC_MAX_SLEW ms toward it, which keeps the jitter of
+// the loop out of the animation.
+#define SYNC_FILTER_PACKETS 4
+#define SYNC_MAX_SLEW 2
+// a slave that hasn't heard a valid packet for this long is no longer locked and steps to the next one it hears
+#define SYNC_LOST_TIMEOUT 2000
+
+class SyncLink {
+    HardwareSerial &m_serial;
+    ReAnimator &m_animator;
+    SyncRole m_role;
+    uint8_t m_link_delay;
+
+    uint32_t m_broadcast_previous_millis;
+    Pattern m_sent_pattern;
+    bool m_sent_reverse;
+
+    uint8_t m_packet[SYNC_PACKET_SIZE];
+    uint8_t m_received;
+    bool m_locked;
+    uint32_t m_packet_previous_millis;
+    int32_t m_max_error;
+    uint8_t m_filter_count;
+
+  public:
+    SyncLink(HardwareSerial &serial, ReAnimator &animator, SyncRole role);
+    void begin(uint32_t baud);
+    void service();
+    SyncRole get_role();
+    bool is_locked();
+
+  private:
+    void broadcast();
+    void receive();
+    void discipline(uint32_t master_time);
+};
+
+#endif
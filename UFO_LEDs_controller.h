@@ -49,6 +49,15 @@
 #define SOUND_VALUE_GAIN_INITIAL 1
 #define HUE_ALIEN_GREEN 112
 
+// EEPROM layout
+#define EEPROM_SIZE 1024
+#define SETTINGS_EEPROM_ADDRESS 0
+#define SETTINGS_EEPROM_SLOTS 16 // SETTINGS_EEPROM_SLOTS*sizeof(SettingsRecord) bytes starting at SETTINGS_EEPROM_ADDRESS
+#define SCRIPT_EEPROM_ADDRESS 512
+#define SCRIPT_EEPROM_SIZE 256
+#define BRIGHTNESS_CACHE_EEPROM_ADDRESS 768
+#define BRIGHTNESS_CACHE_EEPROM_SIZE 256
+
 enum Pattern {            ORBIT = 0, THEATER_CHASE = 1,
                  RUNNING_LIGHTS = 2, SHOOTING_STAR = 3,
                  CYLON = 4, SOLID = 5, JUGGLE = 6, MITOSIS = 7, 
@@ -56,8 +65,27 @@ enum Pattern {            ORBIT = 0, THEATER_CHASE = 1,
                  STARSHIP_RACE = 12, PAC_MAN = 13, BALLS = 14, 
                  HALLOWEEN_FADE = 15, HALLOWEEN_ORBIT = 16, 
                  SOUND_RIBBONS = 17, SOUND_RIPPLE = 18, SOUND_BLOCKS = 19, SOUND_ORBIT = 20,
-                 DYNAMIC_RAINBOW = 21};
+                 DYNAMIC_RAINBOW = 21, SCRIPT = 22,
+                 VERTICAL_SWEEP = 23, ROTATIONAL_SWEEP = 24, RADIAL_SWEEP = 25};
+#define NUM_PATTERNS 26
 enum Overlay {NO_OVERLAY = 0, GLITTER = 1, BREATHING = 2, CONFETTI = 3, FLICKER = 4, FROZEN_DECAY = 5};
+// NO_PALETTE means hues are drawn straight from the color wheel
+enum Palette {NO_PALETTE = 0, HALLOWEEN_PALETTE = 1, ALIEN_PALETTE = 2, FIRE_PALETTE = 3, OCEAN_PALETTE = 4};
+#define NUM_PALETTES 5
+enum SyncRole {SYNC_OFF = 0, SYNC_MASTER = 1, SYNC_SLAVE = 2};
+// where a show cue gets the rim hue from, HUE_SOURCE_KEEP leaves whatever was selected last
+enum HueSource {HUE_SOURCE_KEEP = 0, HUE_SOURCE_DYNAMIC = 1, HUE_SOURCE_STATIC = 2, HUE_SOURCE_RANDOM = 3};
+
+// A run of LEDs for a ReAnimator's patterns to run on. direction is 1 when the patterns' pixel 0 is leds[0] and -1
+// when it is leds[length-1], e.g. for a strip that is wired in from the other end. geometry_offset is where leds[0]
+// is in the Geometry.h tables, e.g. NUM_RIM_LEDS for the beam. A strip that isn't part of the UFO can leave it 0 and
+// the sweep patterns run over it as if it were the rim.
+struct Span {
+    CRGB *leds;
+    uint16_t length;
+    int8_t direction;
+    uint16_t geometry_offset;
+};
 
 #endif
 
@@ -20,16 +20,45 @@
   this software.
 */
 
+// When NEC_DECODER is true the remote is decoded by NECDecoder instead of IRremote (see NECDecoder.h). It uses Timer1.
+#define NEC_DECODER false
+
+#if !NEC_DECODER
 #include <IRremote.h>
+#endif
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
 #include "UFO_LEDs_controller.h"
 #include "ReAnimator.h"
+#include "Settings.h"
+#include "SyncLink.h"
+#include "FrameStream.h"
+#include "ShowSequencer.h"
+#include "BatteryGovernor.h"
+#include "OutputPipeline.h"
+#include "NECDecoder.h"
+#include "FrameExchange.h"
+#include "ParallelOutput.h"
+#include "BrightnessCache.h"
+#include "StackMonitor.h"
+
+// When PARALLEL_OUTPUT is true the rim, beam and helm are sent at the same time instead of one after another
+// (see ParallelOutput.h). The rim has to be moved to pin 9. AVR only.
+#define PARALLEL_OUTPUT false
 
 #define SPEAKER_PIN 4
 
 #define IR_RECV_PIN 12
 #define PAUSE_FOR_IR_INTERVAL 2000
+// After an IR edge wakes the standby sleep stay awake this long so a whole NEC frame (~68 ms) and a repeat can be decoded.
+#define STANDBY_AWAKE_INTERVAL 200
 
+#if PARALLEL_OUTPUT
+#define RIM_LEDS_DATA_PIN 9 // has to be on the same port as the other two (see ParallelOutput.h)
+#else
 #define RIM_LEDS_DATA_PIN 2
+#endif
 #define BEAM_LEDS_DATA_PIN 10
 #define HELM_LEDS_DATA_PIN 8
 #define LED_STRIP_MIN_MILLIAMPS 25
@@ -38,12 +67,58 @@
 #define LED_STRIP_MILLIAMPS_STEP 25
 #define FRAMES_PER_SECOND  120
 
+// only used when SYNC_LINK in ReAnimator.h is true, flash one UFO as the SYNC_MASTER and the rest as SYNC_SLAVE
+#define SYNC_LINK_ROLE SYNC_MASTER
+#define SYNC_LINK_BAUD 115200
+
+// When FRAME_STREAM is true frames sent from a computer over USB are shown instead of the patterns (see FrameStream.h).
+#define FRAME_STREAM false
+#define FRAME_STREAM_BAUD 500000
+
+// When SCRIPT_UPLOAD is true a pattern script sent over USB is stored in EEPROM and run (see PatternVM.h).
+#define SCRIPT_UPLOAD false
+#define SCRIPT_UPLOAD_BAUD 9600
+
+// When BATTERY_GOVERNOR is true the LED strip's current is capped further as the battery drains (see BatteryGovernor.h).
+// Needs a voltage divider from the battery to BATTERY_PIN.
+#define BATTERY_GOVERNOR false
+
+// When OUTPUT_PIPELINE is true frames are gamma corrected and temporally dithered before they are sent, and are only
+// sent when they have changed (see OutputPipeline.h). Costs 3 bytes of RAM per LED.
+#define OUTPUT_PIPELINE false
+
+// When PIPELINED_OUTPUT is true loop() only renders and a task on the other core sends the frames (see FrameExchange.h).
+// ESP32 only.
+#define PIPELINED_OUTPUT false
+#define OUTPUT_TASK_CORE 0
+
+#if (SYNC_LINK + FRAME_STREAM + SCRIPT_UPLOAD) > 1
+#error "only one of SYNC_LINK, FRAME_STREAM and SCRIPT_UPLOAD can use the serial port"
+#endif
+#if SCRIPT_UPLOAD && !PATTERN_SCRIPTS
+#error "SCRIPT_UPLOAD needs PATTERN_SCRIPTS set to true in ReAnimator.h"
+#endif
+
+#if PIPELINED_OUTPUT && !defined(ESP32)
+#error "PIPELINED_OUTPUT needs a second core"
+#endif
+#if PARALLEL_OUTPUT && !defined(__AVR__)
+#error "PARALLEL_OUTPUT writes straight to an AVR port"
+#endif
+#if PIPELINED_OUTPUT && OUTPUT_PIPELINE
+#error "OUTPUT_PIPELINE and PIPELINED_OUTPUT both want to own the arrays FastLED sends"
+#endif
+
 
 const uint8_t PROGMEM HUE3_LUT[3] = {HUE_RED, HUE_ALIEN_GREEN, HUE_BLUE};
 const uint8_t PROGMEM HUE16_LUT[16] = {HUE_RED, 16, HUE_ORANGE, 48, HUE_YELLOW, 80, HUE_GREEN, HUE_ALIEN_GREEN, HUE_AQUA, 144, HUE_BLUE, 176, HUE_PURPLE, 208, HUE_PINK, 240};
 
+#if NEC_DECODER
+NECDecoder nec_decoder;
+#else
 IRrecv irrecv(IR_RECV_PIN);
 decode_results results;
+#endif
 
 CRGB rim_leds[NUM_RIM_LEDS];
 CRGB beam_leds[NUM_BEAM_LEDS];
@@ -54,38 +129,153 @@ uint8_t gstatic_rim_hue = HUE_ALIEN_GREEN; // initialize to green since that is
 uint8_t gstatic_beam_hue = HUE_ALIEN_GREEN;
 uint8_t grandom_hue = 0;
 
+uint16_t gled_strip_milliamps = LED_STRIP_INITIAL_MILLIAMPS;
+
+const uint8_t SOUND_VALUE_GAINS_SIZE = 5;
+const uint8_t SOUND_VALUE_GAINS[SOUND_VALUE_GAINS_SIZE] = {1, 2, 5, 10, 15};
+uint8_t gsound_value_gain_index = 0;
+
+const uint8_t GBP_NUM = 4; // number of patterns on the green button, see loop()
+const uint8_t BBP_NUM = 18; // number of patterns on the blue button
+uint8_t gbpi = 0; // green button pattern index
+uint8_t bbpi = 0; // blue button pattern index
+
+SettingsStore settings_store;
+Settings gsettings;
+
 uint8_t status_led_pin = 13;
 uint8_t status_led_state = LOW;
 
 enum Direction {DOWN = -1, NEUTRAL = 0, UP = 1};
 
-ReAnimator GlowSerum(rim_leds, beam_leds, helm_leds, &gdynamic_hue, &gstatic_beam_hue, LED_STRIP_INITIAL_MILLIAMPS);
+ReAnimatorLayers<NUM_RIM_LEDS> rim_layers;
+ReAnimator GlowSerum(rim_leds, beam_leds, helm_leds, rim_layers, &gdynamic_hue, &gstatic_beam_hue, LED_STRIP_INITIAL_MILLIAMPS);
 
+ShowSequencer show(GlowSerum, &gdynamic_hue, &grandom_hue);
 
-void change_max_brightness(Direction direction) {
+#if SYNC_LINK
+SyncLink sync_link(Serial, GlowSerum, SYNC_LINK_ROLE);
+#endif
+
+#if FRAME_STREAM
+FrameStream frame_stream(Serial, rim_leds, beam_leds, helm_leds);
+#endif
+
+#if SCRIPT_UPLOAD
+ScriptUploader script_uploader;
+#endif
+
+#if BATTERY_GOVERNOR
+BatteryGovernor battery_governor;
+#endif
+
+#if OUTPUT_PIPELINE
+OutputPipeline output_pipeline(rim_leds, beam_leds, helm_leds);
+#endif
+
+#if PIPELINED_OUTPUT
+FrameExchange frame_exchange;
+#endif
+
+#if PARALLEL_OUTPUT
+ParallelOutput parallel_output;
+#endif
+
+#if HOMOGENIZE_BRIGHTNESS
+BrightnessCache brightness_cache;
+#endif
+
+
+// gled_strip_milliamps is what the user chose and what gets saved. The limit actually applied may be lower
+// while the battery is low, and homogenization works from the applied limit.
+void apply_led_strip_milliamps() {
+    uint16_t led_strip_milliamps = gled_strip_milliamps;
+#if BATTERY_GOVERNOR
+    led_strip_milliamps = min(led_strip_milliamps, battery_governor.get_milliamps_cap());
+#endif
+    FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, led_strip_milliamps);
+#if PARALLEL_OUTPUT
+    parallel_output.set_max_power_in_volts_and_milliamps(LED_STRIP_VOLTAGE, led_strip_milliamps);
+#endif
+    GlowSerum.set_selected_led_strip_milliamps(led_strip_milliamps);
+}
+
+
+void set_led_strip_milliamps(uint16_t led_strip_milliamps) {
+    gled_strip_milliamps = led_strip_milliamps;
+    apply_led_strip_milliamps();
+}
+
+
+#if PIPELINED_OUTPUT
+// Copies the LED arrays into the frame exchange for output_task() to send.
+void publish_frame() {
+    Frame &frame = frame_exchange.back();
+    memcpy(frame.rim, rim_leds, sizeof(frame.rim));
+    memcpy(frame.beam, beam_leds, sizeof(frame.beam));
+    memcpy(frame.helm, helm_leds, sizeof(frame.helm));
+    frame.brightness = FastLED.getBrightness();
+    frame_exchange.publish();
+}
+
+
+// Runs on the other core and is the only thing that calls FastLED.show(). The controllers are pointed at whichever
+// slot was just acquired, so sending a frame needs no copy.
+void output_task(void *parameters) {
+    for (;;) {
+        if (frame_exchange.acquire()) {
+            Frame &frame = frame_exchange.front();
+            FastLED[0].setLeds(frame.rim, NUM_RIM_LEDS);
+            FastLED[1].setLeds(frame.beam, NUM_BEAM_LEDS);
+            FastLED[2].setLeds(frame.helm, NUM_HELM_LEDS);
+            FastLED.show(frame.brightness);
+        }
+        else {
+            vTaskDelay(1);
+        }
+    }
+}
+#endif
+
+
+// Sends the arrays registered with FastLED, same as FastLED.show(brightness).
+void send_leds(uint8_t brightness) {
+#if PARALLEL_OUTPUT
+    parallel_output.show(brightness);
+#else
+    FastLED.show(brightness);
+#endif
+}
 
-    static uint16_t selected_led_strip_milliamps = LED_STRIP_INITIAL_MILLIAMPS;
+
+// Shows a frame the sketch drew into the LED arrays itself instead of one drawn by the animations.
+void show_leds() {
+#if OUTPUT_PIPELINE
+    output_pipeline.refresh(FastLED.getBrightness());
+    send_leds(255);
+#elif PIPELINED_OUTPUT
+    publish_frame();
+#else
+    send_leds(FastLED.getBrightness());
+#endif
+}
+
+
+void change_max_brightness(Direction direction) {
 
     if (direction == DOWN) {
-        uint16_t new_led_strip_milliamps = selected_led_strip_milliamps - LED_STRIP_MILLIAMPS_STEP;
+        uint16_t new_led_strip_milliamps = gled_strip_milliamps - LED_STRIP_MILLIAMPS_STEP;
         if (new_led_strip_milliamps >= LED_STRIP_MIN_MILLIAMPS) {
-            FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, new_led_strip_milliamps);
-            selected_led_strip_milliamps = new_led_strip_milliamps;
-            GlowSerum.set_selected_led_strip_milliamps(selected_led_strip_milliamps);
+            set_led_strip_milliamps(new_led_strip_milliamps);
         }
     }
     else if (direction == NEUTRAL) {
-        FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, LED_STRIP_INITIAL_MILLIAMPS);
-        selected_led_strip_milliamps = LED_STRIP_INITIAL_MILLIAMPS;
-        GlowSerum.set_selected_led_strip_milliamps(selected_led_strip_milliamps);
-
+        set_led_strip_milliamps(LED_STRIP_INITIAL_MILLIAMPS);
     }
     else if (direction == UP) {
-        uint16_t new_led_strip_milliamps = selected_led_strip_milliamps + LED_STRIP_MILLIAMPS_STEP;
+        uint16_t new_led_strip_milliamps = gled_strip_milliamps + LED_STRIP_MILLIAMPS_STEP;
         if (new_led_strip_milliamps <= LED_STRIP_MAX_MILLIAMPS) {
-            FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, new_led_strip_milliamps);
-            selected_led_strip_milliamps = new_led_strip_milliamps;
-            GlowSerum.set_selected_led_strip_milliamps(selected_led_strip_milliamps);
+            set_led_strip_milliamps(new_led_strip_milliamps);
         }
     }
 
@@ -93,32 +283,121 @@ void change_max_brightness(Direction direction) {
 
 void change_sound_value_gain() {
 
-    const uint8_t gains_size = 5;
-    static uint8_t gains[gains_size] = {1, 2, 5, 10, 15};
-    static uint8_t gi = 0;
+    uint8_t gain = SOUND_VALUE_GAINS[gsound_value_gain_index];
 
-    GlowSerum.set_sound_value_gain(gains[gi]);
-    uint16_t start = (NUM_RIM_LEDS/2)-(gains[gi]/2);
+    GlowSerum.set_sound_value_gain(gain);
+    uint16_t start = (NUM_RIM_LEDS/2)-(gain/2);
     fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
-    for (uint8_t j = 0; j < gains[gi]; j++) {
+    for (uint8_t j = 0; j < gain; j++) {
         rim_leds[start+j] = CHSV(0, 255, 255);
     }
-    FastLED.show();
-    gi = (gi+1) % gains_size;
+    show_leds();
+    gsound_value_gain_index = (gsound_value_gain_index+1) % SOUND_VALUE_GAINS_SIZE;
+}
+
+
+// what the UFO starts with when nothing has been saved yet
+void default_settings(Settings &settings) {
+    settings.pattern = RUNNING_LIGHTS;
+    settings.reverse = false;
+    settings.transient_overlay = NO_OVERLAY;
+    settings.persistent_overlay = NO_OVERLAY;
+    settings.palette = NO_PALETTE;
+    settings.green_button_index = 0;
+    settings.blue_button_index = 0;
+    settings.static_rim_hue = HUE_ALIEN_GREEN;
+    settings.static_beam_hue = HUE_ALIEN_GREEN;
+    settings.sound_value_gain = SOUND_VALUE_GAIN_INITIAL;
+    settings.led_strip_milliamps = LED_STRIP_INITIAL_MILLIAMPS;
+    settings.autocycle_interval = GlowSerum.get_autocycle_interval()/100;
+    settings.flipflop_interval = GlowSerum.get_flipflop_interval()/100;
+    settings.autocycle_enabled = false;
+    settings.flipflop_enabled = true;
+}
+
+
+// Gather the current state and hand it to the settings store. The store decides when it actually gets written.
+// While a show plays the pattern, its direction, the transient overlay and the palette are the cue's, so the ones
+// remembered before the show started are kept.
+void remember_settings() {
+    if (!show.is_playing()) {
+        gsettings.pattern = GlowSerum.get_pattern();
+        gsettings.reverse = GlowSerum.get_reverse();
+        gsettings.transient_overlay = GlowSerum.get_overlay(false);
+        gsettings.palette = GlowSerum.get_palette();
+    }
+    gsettings.persistent_overlay = GlowSerum.get_overlay(true);
+    gsettings.green_button_index = gbpi;
+    gsettings.blue_button_index = bbpi;
+    gsettings.static_rim_hue = gstatic_rim_hue;
+    gsettings.static_beam_hue = gstatic_beam_hue;
+    // gsound_value_gain_index already points at the next gain
+    gsettings.sound_value_gain = SOUND_VALUE_GAINS[(gsound_value_gain_index+SOUND_VALUE_GAINS_SIZE-1) % SOUND_VALUE_GAINS_SIZE];
+    gsettings.led_strip_milliamps = gled_strip_milliamps;
+    gsettings.autocycle_interval = GlowSerum.get_autocycle_interval()/100;
+    gsettings.flipflop_interval = GlowSerum.get_flipflop_interval()/100;
+    gsettings.autocycle_enabled = GlowSerum.get_autocycle_enabled();
+    gsettings.flipflop_enabled = GlowSerum.get_flipflop_enabled();
+
+    settings_store.save(gsettings);
+}
+
+
+void restore_settings() {
+    uint16_t led_strip_milliamps = gsettings.led_strip_milliamps;
+    if (led_strip_milliamps < LED_STRIP_MIN_MILLIAMPS || led_strip_milliamps > LED_STRIP_MAX_MILLIAMPS) {
+        led_strip_milliamps = LED_STRIP_INITIAL_MILLIAMPS;
+    }
+    set_led_strip_milliamps(led_strip_milliamps);
+
+    gsound_value_gain_index = 0;
+    for (uint8_t i = 0; i < SOUND_VALUE_GAINS_SIZE; i++) {
+        if (SOUND_VALUE_GAINS[i] == gsettings.sound_value_gain) {
+            gsound_value_gain_index = (i+1) % SOUND_VALUE_GAINS_SIZE;
+        }
+    }
+    GlowSerum.set_sound_value_gain(gsettings.sound_value_gain);
+
+    gstatic_rim_hue = gsettings.static_rim_hue;
+    gstatic_beam_hue = gsettings.static_beam_hue;
+    // a record saved by a build with other button lists still passes its CRC
+    gbpi = gsettings.green_button_index % GBP_NUM;
+    bbpi = gsettings.blue_button_index % BBP_NUM;
+
+    GlowSerum.set_palette(static_cast<Palette>(gsettings.palette));
+    GlowSerum.set_pattern(static_cast<Pattern>(gsettings.pattern), gsettings.reverse);
+    GlowSerum.set_overlay(static_cast<Overlay>(gsettings.transient_overlay), false);
+    GlowSerum.set_overlay(static_cast<Overlay>(gsettings.persistent_overlay), true);
+    GlowSerum.set_autocycle_interval(100*static_cast<uint32_t>(gsettings.autocycle_interval));
+    GlowSerum.set_flipflop_interval(100*static_cast<uint32_t>(gsettings.flipflop_interval));
+    GlowSerum.set_autocycle_enabled(gsettings.autocycle_enabled);
+    GlowSerum.set_flipflop_enabled(gsettings.flipflop_enabled);
 }
 
 
 // EVERY_N_MILLISECONDS updates gdynamic_hue continuously
+// After the three starting colors the button steps through the palettes. With a palette selected the dynamic hue
+// sweeps through the palette's colors instead of around the color wheel, and every pattern draws with it.
 void select_dynamic_color() {
 
     static uint8_t h3i = 0;
 
-    gdynamic_hue = pgm_read_word_near(HUE3_LUT + h3i);
+    if (h3i < 3) {
+        gdynamic_hue = pgm_read_byte_near(HUE3_LUT + h3i);
+        GlowSerum.set_palette(NO_PALETTE);
+    }
+    else {
+        gdynamic_hue = 0;
+        GlowSerum.set_palette(static_cast<Palette>(h3i - 2));
+    }
     GlowSerum.set_selected_rim_hue(&gdynamic_hue);
     GlowSerum.set_selected_beam_hue(&gdynamic_hue);
-    fill_solid(rim_leds, NUM_RIM_LEDS, CHSV(gdynamic_hue, 255, 255));
-    fill_solid(beam_leds, NUM_BEAM_LEDS, CHSV(gdynamic_hue, 255, 255));
-    h3i = (h3i+1) % 3;
+    // show the whole palette so it's clear which one was picked
+    for (uint16_t i = 0; i < NUM_RIM_LEDS; i++) {
+        rim_leds[i] = GlowSerum.hue_color((h3i < 3) ? gdynamic_hue : (i*255)/NUM_RIM_LEDS, 255);
+    }
+    fill_solid(beam_leds, NUM_BEAM_LEDS, GlowSerum.hue_color(gdynamic_hue, 255));
+    h3i = (h3i+1) % (3+NUM_PALETTES-1);
 }
 
 
@@ -140,6 +419,7 @@ void select_static_rim_color() {
     static uint8_t h16i = 0;
 
     gstatic_rim_hue = pgm_read_word_near(HUE16_LUT + h16i);
+    GlowSerum.set_palette(NO_PALETTE); // a static color is picked from the color wheel
     GlowSerum.set_selected_rim_hue(&gstatic_rim_hue);
     fill_solid(rim_leds, NUM_RIM_LEDS, CHSV(gstatic_rim_hue, 255, 255));
     h16i = (h16i+1) % 16;
@@ -151,12 +431,79 @@ void select_static_beam_color() {
     static uint8_t h16i = 0;
 
     gstatic_beam_hue = pgm_read_word_near(HUE16_LUT + h16i);
+    GlowSerum.set_palette(NO_PALETTE);
     GlowSerum.set_selected_beam_hue(&gstatic_beam_hue);
     fill_solid(beam_leds, NUM_BEAM_LEDS, CHSV(gstatic_beam_hue, 255, 255));
     h16i = (h16i+1) % 16;
 }
 
 
+// Returns true and sets code when a remote code has been received.
+bool ir_decode(uint32_t &code) {
+#if NEC_DECODER
+    return nec_decoder.decode(code);
+#else
+    if (irrecv.decode(&results)) {
+        code = results.value;
+        irrecv.resume(); // Receive the next value
+        return true;
+    }
+    return false;
+#endif
+}
+
+
+// FastLED.show() turns interrupts off, so LEDs are only sent while no IR frame is arriving.
+bool ir_is_idle() {
+#if NEC_DECODER
+    return nec_decoder.is_idle();
+#else
+    return irrecv.isIdle();
+#endif
+}
+
+
+// Power-down sleep until the IR receiver's output changes. millis() and IRremote's sampling timer stop while asleep.
+// The crystal takes about 1 ms to restart, which only shortens the 9 ms NEC leader mark the decoder sees.
+//
+// Estimated standby current at 5 V (not measured):
+//     ATmega328P in power-down with the ADC off           < 0.01 mA (about 15 mA when loop() spins at 16 MHz)
+//     IR receiver module                                   ~0.5 mA
+//     Nano power LED                                       ~2-3 mA
+//     83 WS2812B showing black, ~0.6-1 mA each             ~50-80 mA
+// The LEDs' own quiescent current dominates, so most of the remaining saving needs a switch on the strips' 5 V.
+void sleep_until_ir_edge() {
+#if defined(__AVR__)
+    uint8_t adcsra = ADCSRA;
+    ADCSRA = 0; // the ADC keeps drawing current while asleep unless it's disabled
+
+#if !NEC_DECODER
+    // NECDecoder keeps the pin change interrupt on all the time
+    *digitalPinToPCMSK(IR_RECV_PIN) |= _BV(digitalPinToPCMSKbit(IR_RECV_PIN));
+    PCIFR = _BV(digitalPinToPCICRbit(IR_RECV_PIN)); // clear a stale flag so it doesn't wake us straight away
+    *digitalPinToPCICR(IR_RECV_PIN) |= _BV(digitalPinToPCICRbit(IR_RECV_PIN));
+#endif
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    // the receiver's output idles high, if it's already low a frame has started and there's no edge left to wake on
+    if (digitalRead(IR_RECV_PIN) == HIGH) {
+        sleep_enable();
+        sei(); // the instruction after sei() always runs, so an edge can't slip in before sleep_cpu()
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+
+#if !NEC_DECODER
+    *digitalPinToPCICR(IR_RECV_PIN) &= ~_BV(digitalPinToPCICRbit(IR_RECV_PIN));
+    *digitalPinToPCMSK(IR_RECV_PIN) &= ~_BV(digitalPinToPCMSKbit(IR_RECV_PIN));
+#endif
+    ADCSRA = adcsra;
+#endif
+}
+
+
 void beep(int8_t beep_type) {
 
     if (beep_type < 0) {
@@ -199,6 +546,19 @@ void beep(int8_t beep_type) {
 
 
 
+#if defined(__AVR__)
+// The IR receiver is on pin 12 (PB4, PCINT4), which is in pin change interrupt group 0.
+#if NEC_DECODER
+ISR(PCINT0_vect) {
+    nec_decoder.handle_edge();
+}
+#else
+// The interrupt only has to wake the CPU, IRremote does the decoding once it's awake.
+EMPTY_INTERRUPT(PCINT0_vect);
+#endif
+#endif
+
+
 void setup() {
 
     analogReference(EXTERNAL);
@@ -206,16 +566,57 @@ void setup() {
     pinMode(status_led_pin, OUTPUT);     
 
     //Serial.begin(57600);
+#if SYNC_LINK
+    sync_link.begin(SYNC_LINK_BAUD);
+#endif
+#if FRAME_STREAM
+    frame_stream.begin(FRAME_STREAM_BAUD);
+#endif
+#if SCRIPT_UPLOAD
+    Serial.begin(SCRIPT_UPLOAD_BAUD);
+#endif
+#if NEC_DECODER
+    nec_decoder.begin(IR_RECV_PIN);
+#else
     irrecv.enableIRIn(); // Start the receiver
+#endif
 
     FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, LED_STRIP_INITIAL_MILLIAMPS);
+#if PARALLEL_OUTPUT
+    parallel_output.set_max_power_in_volts_and_milliamps(LED_STRIP_VOLTAGE, LED_STRIP_INITIAL_MILLIAMPS);
+#endif
     FastLED.setCorrection(TypicalSMD5050);
+#if OUTPUT_PIPELINE
+    // the pipeline does its own dithering, FastLED's would only add to it
+    FastLED.setDither(DISABLE_DITHER);
+    FastLED.addLeds<WS2812B, RIM_LEDS_DATA_PIN, GRB>(output_pipeline.get_rim_output_leds(), NUM_RIM_LEDS);
+    FastLED.addLeds<WS2812B, BEAM_LEDS_DATA_PIN, GRB>(output_pipeline.get_beam_output_leds(), NUM_BEAM_LEDS);
+    FastLED.addLeds<WS2812B, HELM_LEDS_DATA_PIN, GRB>(output_pipeline.get_helm_output_leds(), NUM_HELM_LEDS);
+#else
     FastLED.addLeds<WS2812B, RIM_LEDS_DATA_PIN, GRB>(rim_leds, NUM_RIM_LEDS);
     FastLED.addLeds<WS2812B, BEAM_LEDS_DATA_PIN, GRB>(beam_leds, NUM_BEAM_LEDS);
     FastLED.addLeds<WS2812B, HELM_LEDS_DATA_PIN, GRB>(helm_leds, NUM_HELM_LEDS);
+#endif
+#if PIPELINED_OUTPUT
+    xTaskCreatePinnedToCore(output_task, "output", 2048, NULL, 1, NULL, OUTPUT_TASK_CORE);
+#endif
 
     random16_set_seed(analogRead(A0));
 
+    default_settings(gsettings);
+    settings_store.load(gsettings); // only overwrites the defaults if a valid record is found
+#if HOMOGENIZE_BRIGHTNESS
+    brightness_cache.load(NUM_RIM_LEDS);
+    GlowSerum.set_brightness_cache(&brightness_cache);
+#endif
+
+    // the SCRIPT pattern runs the uploaded script if there is one, otherwise the built-in weave script
+    if (GlowSerum.load_eeprom_script() == INT8_MIN) {
+        GlowSerum.load_builtin_script(SCRIPT_WEAVE);
+    }
+
+    show.load(HALLOWEEN_SHOW, HALLOWEEN_SHOW_CUES, HALLOWEEN_SHOW_BPM);
+
     beep(2);
 }
 
@@ -227,26 +628,24 @@ void loop() {
     static bool is_accepting_commands = false;
     static bool animations_paused = true;
 
-    const uint8_t GBP_NUM = 4;
-    const uint8_t BBP_NUM = 14;
     const Pattern green_button_patterns[GBP_NUM] = {SOUND_RIBBONS, SOUND_RIPPLE, SOUND_BLOCKS, SOUND_ORBIT};
     const Pattern blue_button_patterns[BBP_NUM] = {SOLID, JUGGLE, MITOSIS, BUBBLES, SPARKLE, SOLID, MATRIX,
                                                    WEAVE, STARSHIP_RACE, PAC_MAN, BALLS,
                                                    HALLOWEEN_FADE, HALLOWEEN_ORBIT,
-                                                   DYNAMIC_RAINBOW};
+                                                   DYNAMIC_RAINBOW, SCRIPT,
+                                                   VERTICAL_SWEEP, ROTATIONAL_SWEEP, RADIAL_SWEEP};
     const Overlay blue_button_overlays[BBP_NUM] = {BREATHING, NO_OVERLAY, NO_OVERLAY, NO_OVERLAY, NO_OVERLAY, FLICKER, NO_OVERLAY,
                                                    NO_OVERLAY, NO_OVERLAY, NO_OVERLAY, NO_OVERLAY,
                                                    NO_OVERLAY, NO_OVERLAY,
-                                                   NO_OVERLAY};
-
-    static uint8_t gbpi = 0;
-    static uint8_t bbpi = 0;
+                                                   NO_OVERLAY, NO_OVERLAY,
+                                                   NO_OVERLAY, NO_OVERLAY, NO_OVERLAY};
 
 
     //while (!irrecv.isIdle()); // this might be faster than using if statement below. dt is about 3 ms for while, and about 4 ms for if
 
-    if (irrecv.decode(&results)) {
-        //DEBUG_PRINTHEX(results.value);
+    uint32_t ir_code_received = 0;
+    if (ir_decode(ir_code_received)) {
+        //DEBUG_PRINTHEX(ir_code_received);
         digitalWrite(status_led_pin, !status_led_state);
         status_led_state = !status_led_state;
 
@@ -255,7 +654,7 @@ void loop() {
             static uint16_t button_held_count = 0;
             static uint32_t button_press_previous_millis = 0;
             static uint16_t button_released_interval = 300;
-            uint32_t ir_code = results.value;
+            uint32_t ir_code = ir_code_received;
             uint8_t beep_type = 0;
 
 
@@ -290,10 +689,27 @@ void loop() {
                 case 0xF7C03F: // Power
                     DEBUG_PRINTLN("Power Off");
                     is_accepting_commands = false;
+                    show.stop();
                     previous_ir_code = 0x00000001;  // this ensures the held down code for the power button will do nothing
                     button_held_count = 0;
+                    remember_settings();
+                    settings_store.flush(); // the power may really be switched off next
+#if HOMOGENIZE_BRIGHTNESS
+                    brightness_cache.flush();
+#endif
+#if PIPELINED_OUTPUT
+                    // the controllers' arrays belong to output_task()
+                    fill_solid(rim_leds, NUM_RIM_LEDS, CRGB::Black);
+                    fill_solid(beam_leds, NUM_BEAM_LEDS, CRGB::Black);
+                    fill_solid(helm_leds, NUM_HELM_LEDS, CRGB::Black);
+                    show_leds();
+#else
                     FastLED.clear();
                     FastLED.show();
+#endif
+#if OUTPUT_PIPELINE
+                    output_pipeline.invalidate();
+#endif
                     break;
             //++++++++++ BRIGHTNESS BUTTONS ++++++++++
                 case 0xF7807F: // Down Arrow
@@ -365,6 +781,9 @@ void loop() {
                     DEBUG_PRINTLN("Blue Curtain Closing");
                     previous_ir_code = ir_code;
                     animations_paused = false;
+                    if (!ReAnimator::has_pattern(blue_button_patterns[bbpi])) {
+                        bbpi = (bbpi+1) % BBP_NUM; // e.g. SCRIPT when PATTERN_SCRIPTS is false
+                    }
                     GlowSerum.set_pattern(blue_button_patterns[bbpi]);
                     GlowSerum.set_overlay(blue_button_overlays[bbpi], false);
                     bbpi = (bbpi+1) % BBP_NUM;
@@ -424,12 +843,21 @@ void loop() {
                     GlowSerum.set_pattern(CYLON);
                     break;
             //++++++++++ RECURRENT BUTTONS ++++++++++
-                case 0xF7E01F: // Auto: Cycle through all of the patterns
+                case 0xF7E01F: // Auto: Cycle through all of the patterns, press again to play the show, again to stop
                     DEBUG_PRINTLN("Auto");
                     previous_ir_code = 0x00000001;
                     animations_paused = false;
-                    GlowSerum.set_autocycle_enabled(!GlowSerum.get_autocycle_enabled());
                     GlowSerum.set_flipflop_enabled(false);
+                    if (show.is_playing()) {
+                        show.stop();
+                    }
+                    else if (GlowSerum.get_autocycle_enabled()) {
+                        GlowSerum.set_autocycle_enabled(false);
+                        show.play();
+                    }
+                    else {
+                        GlowSerum.set_autocycle_enabled(true);
+                    }
                     break;
                 case 0xF7D02F: // Loop (circular arrows button): Alternate between the current pattern and the next pattern
                     DEBUG_PRINTLN("Loop");
@@ -445,7 +873,6 @@ void loop() {
                     animations_paused = false;
                     //GlowSerum.set_overlay(NO_OVERLAY, false);
                     GlowSerum.set_overlay(NO_OVERLAY, true);
-                    FastLED.setBrightness(255);
                     break;
                 case 0xF7C837: // Jump
                     DEBUG_PRINTLN("Jump");
@@ -471,22 +898,20 @@ void loop() {
                     for (uint8_t i = 0; i < NUM_RIM_LEDS; i+=2) {
                         rim_leds[i] = CHSV(HUE_RED, 0, 255);
                     }
-                    FastLED.show();
+                    show_leds();
                     break;
             }
 
             beep(beep_type);
+
+            if (is_accepting_commands) {
+                show.service(); // stops a show whose pattern a button just replaced, so the new pattern is remembered
+                remember_settings();
+            }
         }
-        else if (results.value == 0xF7C03F) {
+        else if (ir_code_received == 0xF7C03F) {
             DEBUG_PRINTLN("Power On");
-            change_max_brightness(NEUTRAL);
-            GlowSerum.set_sound_value_gain(SOUND_VALUE_GAIN_INITIAL);
-            gbpi = 0;
-            bbpi = 0;
-            GlowSerum.set_pattern(RUNNING_LIGHTS);
-            GlowSerum.set_overlay(NO_OVERLAY, true);
-            GlowSerum.set_autocycle_enabled(false);
-            GlowSerum.set_flipflop_enabled(true);
+            restore_settings();
             is_accepting_commands = true;
             animations_paused = false;
             beep(0);
@@ -494,27 +919,123 @@ void loop() {
         else {
             DEBUG_PRINTLN("Power is off. Not accepting commands.");
         }
+    }
 
-        irrecv.resume(); // Receive the next value
+#if PIPELINED_OUTPUT && defined(UFO_DEBUG)
+    // frames rendered and sent per second, a frame is dropped when a newer one replaces it before it was sent
+    EVERY_N_SECONDS(10) {
+        static uint32_t published_previous = 0;
+        static uint32_t taken_previous = 0;
+        uint32_t published = frame_exchange.get_published();
+        uint32_t taken = frame_exchange.get_taken();
+        DEBUG_PRINT("rendered fps: ");
+        DEBUG_PRINT((published - published_previous)/10);
+        DEBUG_PRINT(" sent fps: ");
+        DEBUG_PRINTLN((taken - taken_previous)/10);
+        published_previous = published;
+        taken_previous = taken;
+    }
+#endif
+
+#if defined(UFO_DEBUG)
+    // the headroom is the least free RAM there has ever been, which is what decides how far NUM_RIM_LEDS can go up
+    EVERY_N_SECONDS(10) {
+        DEBUG_PRINT("stack headroom: ");
+        DEBUG_PRINT(stack_headroom());
+        DEBUG_PRINT(" free now: ");
+        DEBUG_PRINTLN(free_ram());
+    }
+#endif
+
+#if NEC_DECODER && defined(UFO_DEBUG)
+    // decode rate while rendering
+    EVERY_N_SECONDS(10) {
+        DEBUG_PRINT("IR frames: ");
+        DEBUG_PRINT(nec_decoder.get_frames());
+        DEBUG_PRINT(" repeats: ");
+        DEBUG_PRINT(nec_decoder.get_repeats());
+        DEBUG_PRINT(" errors: ");
+        DEBUG_PRINTLN(nec_decoder.get_errors());
     }
+#endif
+
+    if (!is_accepting_commands) {
+        // In standby nothing is drawn, sampled or shown. The last frame sent at power off was black and the strip
+        // holds it without being refreshed.
+        static uint32_t standby_awake_previous_millis = 0;
+        if (ir_is_idle() && (millis() - standby_awake_previous_millis) > STANDBY_AWAKE_INTERVAL) {
+            sleep_until_ir_edge();
+            standby_awake_previous_millis = millis();
+        }
+        return;
+    }
+
+    settings_store.service();
+#if HOMOGENIZE_BRIGHTNESS
+    brightness_cache.service();
+#endif
+
+#if BATTERY_GOVERNOR
+    if (battery_governor.service()) {
+        apply_led_strip_milliamps();
+    }
+#endif
+
+#if SYNC_LINK
+    sync_link.service();
+#endif
+
+#if SCRIPT_UPLOAD
+    if (script_uploader.service(Serial)) {
+        GlowSerum.load_eeprom_script();
+        GlowSerum.set_pattern(SCRIPT);
+    }
+#endif
 
     if (animations_paused && (millis() - pause_for_ir_previous_millis) > pause_for_ir_interval) {
         pause_for_ir_previous_millis = millis();
         animations_paused = false;
     }
 
+    bool streaming = false;
+    bool new_stream_frame = false;
+#if FRAME_STREAM
     if (is_accepting_commands && !animations_paused) {
+        if (frame_stream.service()) {
+            // the host's frames get the same power limit and brightness homogenization as the patterns
+#if HOMOGENIZE_BRIGHTNESS
+            GlowSerum.homogenize_brightness();
+#endif
+            FastLED.setBrightness(GlowSerum.get_homogenized_brightness());
+            new_stream_frame = true;
+        }
+        streaming = frame_stream.is_streaming();
+    }
+#endif
+
+    if (is_accepting_commands && !animations_paused && !streaming) {
 
+        show.service();
         GlowSerum.reanimate();
 
         EVERY_N_MILLISECONDS(100) { gdynamic_hue+=3; grandom_hue = random8(); }
     }
 
-    if (irrecv.isIdle()) {
+    // while streaming, only show when a whole frame has arrived, a show in the middle of one would lose its bytes
+    if (ir_is_idle() && (!streaming || new_stream_frame)) {
         //FastLED.delay(1000/FRAMES_PER_SECOND);
         //FastLED[0].showLeds(FastLED.getBrightness());
         //FastLED[1].showLeds();
-        FastLED.show(); // only want to use one controller so management of brightness and power usage is more easy
+#if OUTPUT_PIPELINE
+        // the pipeline applies the brightness itself, FastLED only lowers it further if the power limit calls for it
+        if (output_pipeline.update(FastLED.getBrightness(), !animations_paused)) {
+            send_leds(255);
+        }
+#elif PIPELINED_OUTPUT
+        publish_frame();
+#else
+        send_leds(FastLED.getBrightness()); // only want to use one controller so management of brightness and power usage is more easy
+#endif
     }
 
     //print_dt();
@@ -0,0 +1,55 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// AVR's EEPROM library backed by a file, so what a test writes is still there for the next test (or the next run)
+// to read, the same way the real EEPROM survives a power cycle. Every byte written goes straight to the file.
+// The number of times each cell has been written is counted so tests can check the wear levelling.
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HOST_EEPROM_SIZE 1024
+
+class EEPROMClass {
+    FILE *m_file;
+    uint8_t m_cells[HOST_EEPROM_SIZE];
+    uint16_t m_writes[HOST_EEPROM_SIZE];
+
+  public:
+    EEPROMClass();
+    ~EEPROMClass();
+    bool open(const char *path);
+    void erase();
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length();
+    uint16_t get_writes(int address);
+    void clear_writes();
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
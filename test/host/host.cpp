@@ -0,0 +1,121 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+#include "Arduino.h"
+#include "EEPROM.h"
+
+
+uint32_t host_millis = 0;
+int host_analog_value = 0;
+
+EEPROMClass EEPROM;
+
+
+EEPROMClass::EEPROMClass() {
+    m_file = NULL;
+    memset(m_cells, 0xFF, sizeof(m_cells));
+    clear_writes();
+}
+
+
+EEPROMClass::~EEPROMClass() {
+    if (m_file != NULL) {
+        fclose(m_file);
+    }
+}
+
+
+// Reads path if it exists, otherwise starts erased like a new chip and creates it.
+bool EEPROMClass::open(const char *path) {
+    if (m_file != NULL) {
+        fclose(m_file);
+    }
+
+    memset(m_cells, 0xFF, sizeof(m_cells));
+    m_file = fopen(path, "r+b");
+    if (m_file != NULL) {
+        size_t n = fread(m_cells, 1, sizeof(m_cells), m_file);
+        (void)n; // a short file leaves the rest erased
+    }
+    else {
+        m_file = fopen(path, "w+b");
+        if (m_file == NULL) {
+            return false;
+        }
+    }
+
+    fseek(m_file, 0, SEEK_SET);
+    fwrite(m_cells, 1, sizeof(m_cells), m_file);
+    fflush(m_file);
+    clear_writes();
+    return true;
+}
+
+
+// every cell back to 0xFF, without counting it as wear
+void EEPROMClass::erase() {
+    memset(m_cells, 0xFF, sizeof(m_cells));
+    if (m_file != NULL) {
+        fseek(m_file, 0, SEEK_SET);
+        fwrite(m_cells, 1, sizeof(m_cells), m_file);
+        fflush(m_file);
+    }
+}
+
+
+uint8_t EEPROMClass::read(int address) {
+    return m_cells[address % HOST_EEPROM_SIZE];
+}
+
+
+void EEPROMClass::write(int address, uint8_t value) {
+    address %= HOST_EEPROM_SIZE;
+    m_cells[address] = value;
+    m_writes[address]++;
+    if (m_file != NULL) {
+        fseek(m_file, address, SEEK_SET);
+        fputc(value, m_file);
+        fflush(m_file);
+    }
+}
+
+
+void EEPROMClass::update(int address, uint8_t value) {
+    if (read(address) != value) {
+        write(address, value);
+    }
+}
+
+
+uint16_t EEPROMClass::length() {
+    return HOST_EEPROM_SIZE;
+}
+
+
+uint16_t EEPROMClass::get_writes(int address) {
+    return m_writes[address % HOST_EEPROM_SIZE];
+}
+
+
+void EEPROMClass::clear_writes() {
+    memset(m_writes, 0, sizeof(m_writes));
+}
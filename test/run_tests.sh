@@ -0,0 +1,16 @@
+#!/bin/sh
+# Builds and runs the host tests with the PC's compiler. The Arduino IDE doesn't look in test/, so none of this ends
+# up in the sketch. Run from anywhere, e.g. sh test/run_tests.sh
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+mkdir -p build
+failed=0
+for test in test_*.cpp; do
+    name=${test%.cpp}
+    if $CXX -std=gnu++11 -Wall -Wextra -Ihost -I.. -o build/$name $test host/host.cpp; then
+        (cd build && ./$name) || failed=1
+    else
+        failed=1
+    fi
+done
+exit $failed
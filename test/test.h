@@ -0,0 +1,56 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// The few checks the host tests need. Each test_*.cpp is a program of its own that includes the sketch file it tests,
+// runs its checks from main() and returns test_result(), see run_tests.sh.
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static unsigned test_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        unsigned long e = (expected); \
+        unsigned long a = (actual); \
+        if (e != a) { \
+            printf("%s:%d: %s is %lu, expected %lu\n", __FILE__, __LINE__, #actual, a, e); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline int test_result(const char *name) {
+    printf("%s: %s\n", name, (test_failures == 0) ? "passed" : "FAILED");
+    return (test_failures == 0) ? 0 : 1;
+}
+
+#endif
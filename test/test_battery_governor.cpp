@@ -0,0 +1,185 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// BatteryGovernor fed simulated discharge and recovery curves: the cap steps down through the 4900, 4700, 4550 and
+// 4400 mV tiers as the pack drains and only steps back up 150 mV above each threshold.
+
+#include "test.h"
+#include "../BatteryGovernor.cpp"
+
+static const uint16_t thresholds[BATTERY_NUM_TIERS-1] = {4900, 4700, 4550, 4400};
+static const uint16_t caps[BATTERY_NUM_TIERS] = {BATTERY_NO_CAP, 300, 200, 125, 50};
+static const uint16_t hysteresis = 150;
+
+
+// the tier a smoothed voltage belongs to on the way down
+static uint8_t discharge_tier(uint16_t millivolts) {
+    uint8_t tier = 0;
+    while (tier < BATTERY_NUM_TIERS-1 && millivolts < thresholds[tier]) {
+        tier++;
+    }
+    return tier;
+}
+
+
+// feeds millivolts until the smoothed voltage has caught up with it
+static void settle(BatteryGovernor &governor, uint16_t millivolts) {
+    for (uint8_t i = 0; i < 200 && governor.get_millivolts() != millivolts; i++) {
+        governor.update(millivolts);
+    }
+}
+
+
+static void test_starts_from_first_reading() {
+    BatteryGovernor fresh;
+    fresh.update(5500);
+    CHECK_EQUAL(0, fresh.get_tier());
+    CHECK_EQUAL(BATTERY_NO_CAP, fresh.get_milliamps_cap());
+
+    // switched on with a pack that's already low, the cap is right from the first sample
+    BatteryGovernor low;
+    CHECK(low.update(4500));
+    CHECK_EQUAL(3, low.get_tier());
+    CHECK_EQUAL(125, low.get_milliamps_cap());
+}
+
+
+static void test_discharge() {
+    BatteryGovernor governor;
+    governor.update(5600);
+
+    // a pack draining 1 mV per sample, with +-20 mV of ripple from the LEDs' load
+    uint8_t changes = 0;
+    uint8_t previous_tier = 0;
+    for (uint16_t millivolts = 5600; millivolts >= 4200; millivolts--) {
+        int16_t ripple = (millivolts % 4 < 2) ? 20 : -20;
+        bool changed = governor.update(millivolts + ripple);
+        uint8_t tier = governor.get_tier();
+
+        CHECK(tier >= previous_tier); // never climbs while draining
+        CHECK_EQUAL(changed, tier != previous_tier);
+        CHECK_EQUAL(discharge_tier(governor.get_millivolts()), tier);
+        CHECK_EQUAL(caps[tier], governor.get_milliamps_cap());
+
+        changes += changed;
+        previous_tier = tier;
+    }
+
+    CHECK_EQUAL(BATTERY_NUM_TIERS-1, governor.get_tier());
+    CHECK_EQUAL(50, governor.get_milliamps_cap());
+    CHECK_EQUAL(BATTERY_NUM_TIERS-1, changes); // one step per tier, no pumping from the ripple
+}
+
+
+static void test_recovery() {
+    BatteryGovernor governor;
+    governor.update(4200);
+    CHECK_EQUAL(BATTERY_NUM_TIERS-1, governor.get_tier());
+
+    // e.g. the load dropped or the pack is being charged
+    uint8_t changes = 0;
+    uint8_t previous_tier = governor.get_tier();
+    for (uint16_t millivolts = 4200; millivolts <= 5600; millivolts++) {
+        bool changed = governor.update(millivolts);
+        uint8_t tier = governor.get_tier();
+        uint16_t smoothed = governor.get_millivolts();
+
+        CHECK(tier <= previous_tier);
+        if (tier > 0) {
+            // hasn't climbed past the hysteresis above the threshold that would let it up
+            CHECK(smoothed < thresholds[tier-1] + hysteresis);
+        }
+        if (tier < BATTERY_NUM_TIERS-1) {
+            CHECK(smoothed >= thresholds[tier] + hysteresis);
+        }
+
+        changes += changed;
+        previous_tier = tier;
+    }
+
+    CHECK_EQUAL(0, governor.get_tier());
+    CHECK_EQUAL(BATTERY_NO_CAP, governor.get_milliamps_cap());
+    CHECK_EQUAL(BATTERY_NUM_TIERS-1, changes);
+}
+
+
+static void test_hysteresis() {
+    BatteryGovernor governor;
+    governor.update(5000);
+
+    settle(governor, 4690);
+    CHECK_EQUAL(2, governor.get_tier());
+    CHECK_EQUAL(200, governor.get_milliamps_cap());
+
+    // drawing less lets the voltage recover above 4700, but not far enough to raise the cap again
+    settle(governor, 4700 + hysteresis - 1);
+    CHECK_EQUAL(2, governor.get_tier());
+
+    settle(governor, 4700 + hysteresis);
+    CHECK_EQUAL(1, governor.get_tier());
+    CHECK_EQUAL(300, governor.get_milliamps_cap());
+
+    // and on the way back down it drops as soon as it's under the threshold again
+    settle(governor, 4700);
+    CHECK_EQUAL(1, governor.get_tier());
+    settle(governor, 4699);
+    CHECK_EQUAL(2, governor.get_tier());
+}
+
+
+static void test_sample_is_smoothed() {
+    BatteryGovernor governor;
+    governor.update(5000);
+
+    // a single dip, e.g. every LED turning white for a frame, doesn't cut the cap
+    CHECK(!governor.update(4000));
+    CHECK_EQUAL(0, governor.get_tier());
+    CHECK(governor.get_millivolts() > 4900);
+}
+
+
+static void test_service_reads_adc() {
+    BatteryGovernor governor;
+    // 2.4 V on the pin through the 2:1 divider is 4.8 V
+    host_analog_value = (2400UL*1024)/BATTERY_AREF_MILLIVOLTS;
+    host_millis = BATTERY_SAMPLE_INTERVAL;
+    CHECK(governor.service());
+    CHECK_EQUAL(1, governor.get_tier());
+
+    // not again until the next sample is due
+    host_analog_value = 0;
+    host_millis += BATTERY_SAMPLE_INTERVAL-1;
+    CHECK(!governor.service());
+    CHECK(governor.get_millivolts() > 4700);
+}
+
+
+int main() {
+    test_starts_from_first_reading();
+    test_discharge();
+    test_recovery();
+    test_hysteresis();
+    test_sample_is_smoothed();
+    test_service_reads_adc();
+
+    return test_result("battery governor");
+}
@@ -0,0 +1,281 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// NECDecoder::edge() fed synthetic mark/space traces. FastLED.show() is modelled as a window with interrupts off:
+// the edges inside it are handled once, when it ends, at whatever level the receiver's output is at by then.
+
+#include "test.h"
+#include "../NECDecoder.cpp"
+
+#define SHOW_US 2500 // FastLED.show() with interrupts off for the UFO's 83 LEDs
+#define MAX_EDGES 160
+
+struct Signal {
+    uint32_t times[MAX_EDGES]; // us
+    bool marks[MAX_EDGES];     // the level after each edge
+    uint8_t length;
+    uint32_t end;              // where the next frame may start
+};
+
+struct Window {
+    uint32_t start;
+    uint32_t end;
+};
+
+
+static void add_level(Signal &signal, bool mark, uint32_t us) {
+    signal.times[signal.length] = signal.end;
+    signal.marks[signal.length] = mark;
+    signal.length++;
+    signal.end += us;
+}
+
+
+static void add_frame(Signal &signal, uint32_t code) {
+    add_level(signal, true, 9000);
+    add_level(signal, false, 4500);
+    for (int8_t i = 31; i >= 0; i--) {
+        add_level(signal, true, 562);
+        add_level(signal, false, ((code >> i) & 1) ? 1687 : 562);
+    }
+    add_level(signal, true, 562);
+    add_level(signal, false, 40000);
+}
+
+
+static void add_repeat(Signal &signal) {
+    add_level(signal, true, 9000);
+    add_level(signal, false, 2250);
+    add_level(signal, true, 562);
+    add_level(signal, false, 96000);
+}
+
+
+// Hands the decoder one edge, the way handle_edge() would with the timer read at us.
+class Receiver {
+    NECDecoder &m_decoder;
+    uint32_t m_previous_us;
+
+  public:
+    Receiver(NECDecoder &decoder) : m_decoder(decoder) {
+        m_previous_us = 0;
+    }
+
+    void edge(uint32_t us, bool mark) {
+        m_decoder.edge(static_cast<uint16_t>((us - m_previous_us)/NEC_TICK_US), mark);
+        m_previous_us = us;
+    }
+};
+
+
+// plays signal with interrupts off during each of the windows
+static void play(NECDecoder &decoder, const Signal &signal, const Window *windows, uint8_t num_windows) {
+    Receiver receiver(decoder);
+    uint8_t w = 0;
+    uint8_t i = 0;
+    while (i < signal.length) {
+        while (w < num_windows && windows[w].end <= signal.times[i]) {
+            w++;
+        }
+        if (w < num_windows && signal.times[i] >= windows[w].start) {
+            // every edge in the window is one interrupt when it ends
+            bool mark = signal.marks[i];
+            while (i < signal.length && signal.times[i] < windows[w].end) {
+                mark = signal.marks[i++];
+            }
+            receiver.edge(windows[w].end, mark);
+        }
+        else {
+            receiver.edge(signal.times[i], signal.marks[i]);
+            i++;
+        }
+    }
+}
+
+
+static void test_clean_frame() {
+    NECDecoder decoder;
+    Signal signal = {};
+    add_frame(signal, 0xF7C03F);
+    play(decoder, signal, NULL, 0);
+
+    uint32_t code = 0;
+    CHECK(decoder.decode(code));
+    CHECK_EQUAL(0xF7C03F, code);
+    CHECK(!decoder.decode(code)); // only once
+    CHECK_EQUAL(1, decoder.get_frames());
+    CHECK_EQUAL(0, decoder.get_errors());
+    CHECK(decoder.is_idle());
+}
+
+
+static void test_repeat_frame() {
+    NECDecoder decoder;
+    Signal signal = {};
+    add_frame(signal, 0xF7E01F);
+    add_repeat(signal);
+    play(decoder, signal, NULL, 0);
+
+    uint32_t code = 0;
+    CHECK(decoder.decode(code));
+    CHECK_EQUAL(NEC_REPEAT, code);
+    CHECK_EQUAL(1, decoder.get_frames());
+    CHECK_EQUAL(1, decoder.get_repeats());
+    CHECK_EQUAL(0, decoder.get_errors());
+}
+
+
+static void test_late_leader() {
+    NECDecoder decoder;
+    Signal signal = {};
+    signal.end = 1000;
+    add_frame(signal, 0xF7A05F);
+
+    // the leader mark starts just as a show turns interrupts off, so it's 2.5 ms short when it's timestamped
+    Window show = {1000, 1000 + SHOW_US};
+    play(decoder, signal, &show, 1);
+
+    uint32_t code = 0;
+    CHECK(decoder.decode(code));
+    CHECK_EQUAL(0xF7A05F, code);
+    CHECK_EQUAL(0, decoder.get_errors());
+}
+
+
+static void test_busy_during_frame() {
+    NECDecoder decoder;
+    Signal signal = {};
+    add_frame(signal, 0xF7A05F);
+
+    // the leader and a few bits, the sketch must not show now
+    Signal part = signal;
+    part.length = 10;
+    play(decoder, part, NULL, 0);
+    CHECK(!decoder.is_idle());
+}
+
+
+static void test_lost_edges_are_counted() {
+    uint32_t code = 0;
+
+    // two edges of a bit lost, so the next one is the same level as the last
+    NECDecoder even;
+    Signal signal = {};
+    add_frame(signal, 0xF7609F);
+    Window show = {signal.times[20] - 100, signal.times[21] + 100};
+    play(even, signal, &show, 1);
+    CHECK(!even.decode(code));
+    CHECK(even.get_errors() > 0);
+    CHECK_EQUAL(0, even.get_frames());
+
+    // one edge held back by a show, so a space comes out far too long
+    NECDecoder odd;
+    show.start = signal.times[21] - 100;
+    show.end = show.start + SHOW_US;
+    play(odd, signal, &show, 1);
+    CHECK(!odd.decode(code));
+    CHECK(odd.get_errors() > 0);
+    CHECK_EQUAL(0, odd.get_frames());
+
+    // a leader cut short by more than a show is thrown away too
+    NECDecoder leader;
+    Signal late = {};
+    add_frame(late, 0xF7609F);
+    show.start = 0;
+    show.end = 4500;
+    play(leader, late, &show, 1);
+    CHECK(!leader.decode(code));
+    CHECK(leader.get_errors() > 0);
+
+    // and the next frame still decodes
+    add_frame(signal, 0xF7906F);
+    NECDecoder recovers;
+    show.start = signal.times[20] - 100;
+    show.end = signal.times[21] + 100;
+    play(recovers, signal, &show, 1);
+    CHECK(recovers.decode(code));
+    CHECK_EQUAL(0xF7906F, code);
+    CHECK_EQUAL(1, recovers.get_frames());
+    CHECK(recovers.get_errors() > 0);
+}
+
+
+// The sketch shows a frame of LEDs every frame_us, but only when is_idle() says no IR frame is arriving, so a show
+// can only ever land on a leader mark. Presses at every phase of the render loop should all decode.
+static void test_continuous_rendering() {
+    const uint32_t frame_us = 16667;
+    const uint32_t code = 0xF7C837;
+    uint16_t presses = 0;
+    uint16_t decoded = 0;
+
+    for (uint32_t phase = 0; phase < frame_us; phase += 97) {
+        NECDecoder decoder;
+        Receiver receiver(decoder);
+        Signal signal = {};
+        signal.end = 20000 + phase;
+        add_frame(signal, code);
+        add_repeat(signal);
+
+        uint32_t show_us = 0;
+        uint8_t i = 0;
+        while (i < signal.length) {
+            if (signal.times[i] < show_us) {
+                receiver.edge(signal.times[i], signal.marks[i]);
+                i++;
+                continue;
+            }
+            if (decoder.is_idle()) {
+                bool pending = false;
+                bool mark = false;
+                while (i < signal.length && signal.times[i] < show_us + SHOW_US) {
+                    mark = signal.marks[i++];
+                    pending = true;
+                }
+                if (pending) {
+                    receiver.edge(show_us + SHOW_US, mark);
+                }
+            }
+            show_us += frame_us;
+        }
+
+        uint32_t received = 0;
+        presses++;
+        if (decoder.get_frames() == 1 && decoder.get_repeats() == 1 && decoder.decode(received) && received == NEC_REPEAT) {
+            decoded++;
+        }
+    }
+
+    printf("decoded %u of %u presses while rendering at 60 fps\n", decoded, presses);
+    CHECK_EQUAL(presses, decoded);
+}
+
+
+int main() {
+    test_clean_frame();
+    test_repeat_frame();
+    test_late_leader();
+    test_busy_during_frame();
+    test_lost_edges_are_counted();
+    test_continuous_rendering();
+
+    return test_result("NEC decoder");
+}
@@ -0,0 +1,283 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// ParallelOutput's bit-plane transposition. send_bytes()'s inline assembly can't run on a PC, so this steps through
+// the same text (PARALLEL_OUTPUT_BYTE) with a model of the few AVR instructions it uses and their cycle counts, and
+// checks every write to the port against parallel_output_mask() and the WS2812B's timing. It also prints the
+// kernel's cycle budget, which is what the strips actually see, since host timings say nothing about the AVR.
+
+#include "test.h"
+#include "../ParallelOutput.cpp"
+
+#define CPU_MHZ 16
+#define MAX_INSTRUCTIONS 160
+#define BITS_PER_BYTE 8
+
+// WS2812B datasheet: T0H 0.4 us and T1H 0.8 us, both +-150 ns, and a bit period of 1.25 us +-600 ns
+#define T0H_MIN_NS 250
+#define T0H_MAX_NS 550
+#define T1H_MIN_NS 650
+#define T1H_MAX_NS 950
+#define BIT_MIN_NS 650
+#define BIT_MAX_NS 1850
+
+enum Opcode {OP_OUT, OP_RJMP, OP_NOP, OP_MOV, OP_SBRC, OP_ORI};
+enum Operand {R_MASK, R_HI, R_LO, R_RIM, R_BEAM, R_HELM, NUM_REGISTERS};
+
+struct Instruction {
+    Opcode opcode;
+    uint8_t a;
+    uint8_t b; // a register, a bit number or an immediate
+};
+
+struct PortWrite {
+    uint16_t cycle;
+    uint8_t value;
+};
+
+static Instruction program[MAX_INSTRUCTIONS];
+static uint8_t program_length = 0;
+
+
+static uint8_t parse_register(const char *operand) {
+    static const char *names[NUM_REGISTERS] = {"%[mask]", "%[hi]", "%[lo]", "%[rim]", "%[beam]", "%[helm]"};
+    for (uint8_t i = 0; i < NUM_REGISTERS; i++) {
+        if (strcmp(operand, names[i]) == 0) {
+            return i;
+        }
+    }
+    printf("unknown register %s\n", operand);
+    test_failures++;
+    return R_MASK;
+}
+
+
+static uint8_t parse_immediate(const char *operand) {
+    if (strcmp(operand, "%[rim_bit]") == 0) {
+        return 1 << PARALLEL_OUTPUT_RIM_BIT;
+    }
+    if (strcmp(operand, "%[beam_bit]") == 0) {
+        return 1 << PARALLEL_OUTPUT_BEAM_BIT;
+    }
+    if (strcmp(operand, "%[helm_bit]") == 0) {
+        return 1 << PARALLEL_OUTPUT_HELM_BIT;
+    }
+    printf("unknown immediate %s\n", operand);
+    test_failures++;
+    return 0;
+}
+
+
+// Turns the assembly text into instructions. Anything it doesn't know fails the test, so a change to the kernel that
+// uses another instruction has to come with its cycle count here.
+static void assemble(const char *text) {
+    char line[64];
+    while (*text) {
+        const char *end = strstr(text, "\n\t");
+        size_t length = end ? static_cast<size_t>(end - text) : strlen(text);
+        memcpy(line, text, length);
+        line[length] = '\0';
+        text += length + (end ? 2 : 0);
+
+        char mnemonic[8] = "";
+        char a[16] = "";
+        char b[16] = "";
+        sscanf(line, "%7s %15[^,], %15s", mnemonic, a, b);
+
+        Instruction &instruction = program[program_length++];
+        if (strcmp(mnemonic, "out") == 0) {
+            instruction.opcode = OP_OUT;
+            instruction.b = parse_register(b);
+        }
+        else if (strcmp(mnemonic, "rjmp") == 0 && strcmp(a, ".+0") == 0) {
+            instruction.opcode = OP_RJMP;
+        }
+        else if (strcmp(mnemonic, "nop") == 0) {
+            instruction.opcode = OP_NOP;
+        }
+        else if (strcmp(mnemonic, "mov") == 0) {
+            instruction.opcode = OP_MOV;
+            instruction.a = parse_register(a);
+            instruction.b = parse_register(b);
+        }
+        else if (strcmp(mnemonic, "sbrc") == 0) {
+            instruction.opcode = OP_SBRC;
+            instruction.a = parse_register(a);
+            instruction.b = atoi(b);
+        }
+        else if (strcmp(mnemonic, "ori") == 0) {
+            instruction.opcode = OP_ORI;
+            instruction.a = parse_register(a);
+            instruction.b = parse_immediate(b);
+        }
+        else {
+            printf("unknown instruction %s\n", line);
+            test_failures++;
+            program_length--;
+        }
+    }
+}
+
+
+// Runs the kernel for one byte of each strip and returns how many cycles it took. Every instruction is one word,
+// so sbrc takes 2 cycles when it skips.
+static uint16_t run(uint8_t rim, uint8_t beam, uint8_t helm, uint8_t lo, PortWrite *writes, uint8_t &num_writes) {
+    uint8_t r[NUM_REGISTERS] = {0, static_cast<uint8_t>(lo | PARALLEL_OUTPUT_MASK), lo, rim, beam, helm};
+    uint16_t cycle = 0;
+    num_writes = 0;
+
+    for (uint8_t pc = 0; pc < program_length; pc++) {
+        const Instruction &instruction = program[pc];
+        switch (instruction.opcode) {
+            case OP_OUT:
+                writes[num_writes].cycle = cycle;
+                writes[num_writes].value = r[instruction.b];
+                num_writes++;
+                cycle += 1;
+                break;
+            case OP_RJMP:
+                cycle += 2;
+                break;
+            case OP_NOP:
+                cycle += 1;
+                break;
+            case OP_MOV:
+                r[instruction.a] = r[instruction.b];
+                cycle += 1;
+                break;
+            case OP_SBRC:
+                if ((r[instruction.a] >> instruction.b) & 1) {
+                    cycle += 1;
+                }
+                else {
+                    pc++;
+                    cycle += 2;
+                }
+                break;
+            case OP_ORI:
+                r[instruction.a] |= instruction.b;
+                cycle += 1;
+                break;
+        }
+    }
+
+    return cycle;
+}
+
+
+static uint16_t cycles_to_ns(uint16_t cycles) {
+    return (cycles*1000)/CPU_MHZ;
+}
+
+
+// Checks one byte of each strip: the writes are the transposed masks, and each strip's pin spells out its byte with
+// highs of the right length.
+static void check_bytes(uint8_t rim, uint8_t beam, uint8_t helm, uint8_t lo, uint16_t &total_cycles) {
+    PortWrite writes[3*BITS_PER_BYTE+1];
+    uint8_t num_writes = 0;
+    total_cycles = run(rim, beam, helm, lo, writes, num_writes);
+
+    CHECK_EQUAL(3*BITS_PER_BYTE, num_writes);
+    if (num_writes != 3*BITS_PER_BYTE) {
+        return;
+    }
+
+    const uint8_t hi = lo | PARALLEL_OUTPUT_MASK;
+    const uint8_t strips[3] = {rim, beam, helm};
+    const uint8_t pins[3] = {PARALLEL_OUTPUT_RIM_BIT, PARALLEL_OUTPUT_BEAM_BIT, PARALLEL_OUTPUT_HELM_BIT};
+
+    for (uint8_t i = 0; i < BITS_PER_BYTE; i++) {
+        uint8_t bit = 7-i;
+        const PortWrite *w = &writes[3*i];
+        CHECK_EQUAL(hi, w[0].value);
+        CHECK_EQUAL(parallel_output_mask(rim, beam, helm, bit, lo), w[1].value);
+        CHECK_EQUAL(lo, w[2].value);
+        if (i > 0) {
+            uint16_t period = cycles_to_ns(w[0].cycle - writes[3*(i-1)].cycle);
+            CHECK(period >= BIT_MIN_NS && period <= BIT_MAX_NS);
+        }
+
+        // what each strip sees on its own pin
+        for (uint8_t s = 0; s < 3; s++) {
+            uint16_t high_ns = cycles_to_ns(((w[1].value >> pins[s]) & 1) ? w[2].cycle - w[0].cycle : w[1].cycle - w[0].cycle);
+            if ((strips[s] >> bit) & 1) {
+                CHECK(high_ns >= T1H_MIN_NS && high_ns <= T1H_MAX_NS);
+            }
+            else {
+                CHECK(high_ns >= T0H_MIN_NS && high_ns <= T0H_MAX_NS);
+            }
+        }
+    }
+}
+
+
+static void test_reference_mask() {
+    // each strip's bit lands on its own pin and the port's other pins are left alone
+    for (uint16_t value = 0; value < 256; value++) {
+        for (uint8_t bit = 0; bit < BITS_PER_BYTE; bit++) {
+            uint8_t set = (value >> bit) & 1;
+            CHECK_EQUAL(0xF8 | (set << PARALLEL_OUTPUT_RIM_BIT), parallel_output_mask(value, 0, 0, bit, 0xF8));
+            CHECK_EQUAL(set << PARALLEL_OUTPUT_BEAM_BIT, parallel_output_mask(0, value, 0, bit, 0));
+            CHECK_EQUAL(0x30 | (set << PARALLEL_OUTPUT_HELM_BIT), parallel_output_mask(0xFF, 0xFF, value, bit, 0x30) & ~((1 << PARALLEL_OUTPUT_RIM_BIT) | (1 << PARALLEL_OUTPUT_BEAM_BIT)));
+        }
+    }
+}
+
+
+static void test_kernel() {
+    uint16_t min_cycles = UINT16_MAX;
+    uint16_t max_cycles = 0;
+    uint16_t cycles = 0;
+
+    // every value on every strip against a spread of the others, and the other pins on the port high and low
+    for (uint16_t value = 0; value < 256; value++) {
+        const uint8_t others[] = {0x00, 0xFF, 0xAA, 0x55, static_cast<uint8_t>(value*37+11)};
+        for (uint8_t o = 0; o < sizeof(others); o++) {
+            const uint8_t lo = (o & 1) ? 0xF8 : 0x00;
+            check_bytes(value, others[o], static_cast<uint8_t>(~others[o]), lo, cycles);
+            min_cycles = min(min_cycles, cycles);
+            max_cycles = max(max_cycles, cycles);
+            check_bytes(others[o], value, others[o], lo, cycles);
+            check_bytes(static_cast<uint8_t>(~others[o]), others[o], value, lo, cycles);
+        }
+    }
+
+    // sbrc and ori have to take the same time either way or the bits' timing would depend on the data
+    CHECK_EQUAL(min_cycles, max_cycles);
+
+    PortWrite writes[3*BITS_PER_BYTE+1];
+    uint8_t num_writes = 0;
+    run(0x00, 0xFF, 0x0F, 0, writes, num_writes);
+    printf("per byte: %u cycles (%u ns), bit period %u ns, T0H %u ns, T1H %u ns, %u cycles before the first bit\n",
+           max_cycles, cycles_to_ns(max_cycles), cycles_to_ns(writes[3].cycle - writes[0].cycle),
+           cycles_to_ns(writes[1].cycle - writes[0].cycle), cycles_to_ns(writes[2].cycle - writes[0].cycle), writes[0].cycle);
+}
+
+
+int main() {
+    assemble(PARALLEL_OUTPUT_BYTE);
+
+    test_reference_mask();
+    test_kernel();
+
+    return test_result("parallel output");
+}
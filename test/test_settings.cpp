@@ -0,0 +1,220 @@
+/*
+  This code is copyright 2019 Jonathan Thomson, jethomson.wordpress.com
+
+  Permission to use, copy, modify, and distribute this software
+  and its documentation for any purpose and without fee is hereby
+  granted, provided that the above copyright notice appear in all
+  copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+// SettingsStore against the file-backed EEPROM stand-in: records survive a "power cycle", saves are coalesced,
+// writes are spread over the ring and a torn or foreign record is skipped.
+
+#include "test.h"
+#include "../Settings.cpp"
+
+#define EEPROM_FILE "settings_eeprom.bin"
+
+
+static Settings make_settings(uint8_t pattern, uint16_t milliamps) {
+    Settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.pattern = pattern;
+    settings.static_rim_hue = HUE_ALIEN_GREEN;
+    settings.led_strip_milliamps = milliamps;
+    settings.autocycle_interval = 300;
+    settings.flipflop_interval = 150;
+    settings.flipflop_enabled = 1;
+    return settings;
+}
+
+
+// writes a record straight into slot, the way a store with that sequence number would have
+static void put_record(uint8_t slot, uint16_t sequence, const Settings &settings) {
+    SettingsRecord record;
+    memset(&record, 0, sizeof(record));
+    record.version = SETTINGS_VERSION;
+    record.sequence = sequence;
+    record.settings = settings;
+    record.crc = crc8(reinterpret_cast<const uint8_t *>(&record), offsetof(SettingsRecord, crc));
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+    for (uint8_t i = 0; i < sizeof(SettingsRecord); i++) {
+        EEPROM.write(SETTINGS_EEPROM_ADDRESS + slot*sizeof(SettingsRecord) + i, data[i]);
+    }
+}
+
+
+static uint16_t settings_writes() {
+    uint16_t writes = 0;
+    for (uint16_t i = 0; i < SETTINGS_EEPROM_SLOTS*sizeof(SettingsRecord); i++) {
+        writes += EEPROM.get_writes(SETTINGS_EEPROM_ADDRESS+i);
+    }
+    return writes;
+}
+
+
+static void test_new_board() {
+    EEPROM.erase();
+    SettingsStore store;
+    Settings settings = make_settings(ORBIT, 500);
+    CHECK(!store.load(settings));
+    CHECK_EQUAL(ORBIT, settings.pattern); // the caller's defaults are left alone
+}
+
+
+static void test_survives_power_cycle() {
+    EEPROM.erase();
+    {
+        SettingsStore store;
+        Settings settings;
+        store.load(settings);
+        store.save(make_settings(PAC_MAN, 900));
+        store.flush();
+    }
+
+    // a new store and a reopened file, like the next boot
+    CHECK(EEPROM.open(EEPROM_FILE));
+    SettingsStore store;
+    Settings settings = make_settings(ORBIT, 500);
+    CHECK(store.load(settings));
+    CHECK_EQUAL(PAC_MAN, settings.pattern);
+    CHECK_EQUAL(900, settings.led_strip_milliamps);
+}
+
+
+static void test_saves_are_coalesced() {
+    EEPROM.erase();
+    EEPROM.clear_writes();
+    SettingsStore store;
+    Settings settings;
+    store.load(settings);
+
+    host_millis = 10000;
+    for (uint8_t i = 0; i < 10; i++) {
+        // e.g. stepping through the milliamp settings
+        store.save(make_settings(CYLON, 100*(i+1)));
+        host_millis += 500;
+        store.service();
+    }
+    CHECK_EQUAL(0, settings_writes());
+
+    host_millis += SETTINGS_SAVE_DELAY + 1;
+    store.service();
+    CHECK(settings_writes() > 0);
+    CHECK(settings_writes() <= sizeof(SettingsRecord));
+
+    // saving what's already saved writes nothing
+    uint16_t writes = settings_writes();
+    store.save(make_settings(CYLON, 1000));
+    host_millis += SETTINGS_SAVE_DELAY + 1;
+    store.service();
+    CHECK_EQUAL(writes, settings_writes());
+
+    SettingsStore next_boot;
+    CHECK(next_boot.load(settings));
+    CHECK_EQUAL(1000, settings.led_strip_milliamps);
+}
+
+
+static void test_writes_are_levelled() {
+    const uint8_t rounds = 4;
+
+    EEPROM.erase();
+    EEPROM.clear_writes();
+    SettingsStore store;
+    Settings settings;
+    store.load(settings);
+
+    for (uint16_t i = 0; i < rounds*SETTINGS_EEPROM_SLOTS; i++) {
+        store.save(make_settings(i % NUM_PATTERNS, 100+i));
+        store.flush();
+    }
+
+    // every slot took its turn, and no cell was written more often than once per turn
+    for (uint8_t slot = 0; slot < SETTINGS_EEPROM_SLOTS; slot++) {
+        uint16_t address = SETTINGS_EEPROM_ADDRESS + slot*sizeof(SettingsRecord);
+        CHECK_EQUAL(rounds, EEPROM.get_writes(address + offsetof(SettingsRecord, sequence)));
+        for (uint8_t i = 0; i < sizeof(SettingsRecord); i++) {
+            CHECK(EEPROM.get_writes(address+i) <= rounds);
+        }
+    }
+
+    SettingsStore next_boot;
+    CHECK(next_boot.load(settings));
+    CHECK_EQUAL(100 + rounds*SETTINGS_EEPROM_SLOTS - 1, settings.led_strip_milliamps);
+}
+
+
+static void test_torn_record_is_skipped() {
+    EEPROM.erase();
+    put_record(5, 41, make_settings(BUBBLES, 300));
+    put_record(6, 42, make_settings(MATRIX, 400));
+    // the power went while slot 6 was being written
+    uint16_t address = SETTINGS_EEPROM_ADDRESS + 6*sizeof(SettingsRecord) + offsetof(SettingsRecord, settings);
+    EEPROM.write(address, EEPROM.read(address) ^ 0x5A);
+
+    SettingsStore store;
+    Settings settings;
+    CHECK(store.load(settings));
+    CHECK_EQUAL(BUBBLES, settings.pattern);
+
+    // the next save goes after the record that was loaded, over the torn one
+    store.save(make_settings(WEAVE, 500));
+    store.flush();
+    SettingsStore next_boot;
+    CHECK(next_boot.load(settings));
+    CHECK_EQUAL(WEAVE, settings.pattern);
+}
+
+
+static void test_other_version_is_ignored() {
+    EEPROM.erase();
+    put_record(0, 1, make_settings(SPARKLE, 300));
+    EEPROM.write(SETTINGS_EEPROM_ADDRESS + offsetof(SettingsRecord, version), SETTINGS_VERSION+1);
+
+    SettingsStore store;
+    Settings settings = make_settings(ORBIT, 500);
+    CHECK(!store.load(settings));
+    CHECK_EQUAL(ORBIT, settings.pattern);
+}
+
+
+static void test_sequence_wraps() {
+    EEPROM.erase();
+    put_record(SETTINGS_EEPROM_SLOTS-1, 0xFFFF, make_settings(JUGGLE, 300));
+    put_record(0, 0x0000, make_settings(BALLS, 400));
+
+    SettingsStore store;
+    Settings settings;
+    CHECK(store.load(settings));
+    CHECK_EQUAL(BALLS, settings.pattern);
+}
+
+
+int main() {
+    CHECK(EEPROM.open(EEPROM_FILE));
+
+    test_new_board();
+    test_survives_power_cycle();
+    test_saves_are_coalesced();
+    test_writes_are_levelled();
+    test_torn_record_is_skipped();
+    test_other_version_is_ignored();
+    test_sequence_wraps();
+
+    return test_result("settings");
+}